@@ -20,7 +20,7 @@ class InexorgluegenConan(ConanFile):
 
     def build(self):
         cmake = CMake(self)
-        args = [""]
+        args = ["-DGLUEGEN_VERSION={}".format(self.version)]
         self.run('cmake . {} {}'.format(cmake.command_line, " ".join(args)))
         self.run("cmake --build . {}".format(cmake.build_config))
 
@@ -0,0 +1,157 @@
+#include "inexor/filesystem/file_watcher.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace bfs = boost::filesystem;
+
+namespace inexor { namespace filesystem {
+
+file_watcher::watched_directory &file_watcher::watch_directory(const Path &directory)
+{
+    Path path = directory.empty() ? Path(".") : directory;
+    path.make_preferred();
+    for(watched_directory &dir : directories)
+        if(dir.path == path) return dir;
+
+    directories.emplace_back();
+    directories.back().path = path;
+#ifdef __linux__
+    // the same directory always gets the same watch descriptor, so it can not end up twice in here.
+    const int watch = inotify_add_watch(inotify_fd, path.string().c_str(),
+                                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+    if(watch >= 0) watches[watch] = directories.size() - 1;
+#endif
+    return directories.back();
+}
+
+void file_watcher::add_directory(const Path &directory, bool recursive)
+{
+    watch_directory(directory).all_files = true;
+    if(recursive)
+    {
+        boost::system::error_code err;
+        for(bfs::recursive_directory_iterator it(directory, err), end; !err && it != end; it.increment(err))
+            if(bfs::is_directory(it->path())) watch_directory(it->path()).all_files = true;
+    }
+#ifndef __linux__
+    snapshot = take_snapshot();
+#endif
+}
+
+void file_watcher::add_file(const Path &file)
+{
+    watch_directory(file.parent_path()).single_files[file.filename().string()] = file;
+#ifndef __linux__
+    snapshot = take_snapshot();
+#endif
+}
+
+void file_watcher::add_change(const watched_directory &dir, const std::string &file_name, std::vector<Path> &changes) const
+{
+    Path changed;
+    const auto single_file = dir.single_files.find(file_name);
+    if(single_file != dir.single_files.end()) changed = single_file->second;
+    else if(dir.all_files) changed = dir.path / file_name;
+    else return;
+
+    if(std::find(changes.begin(), changes.end(), changed) == changes.end()) changes.push_back(changed);
+}
+
+std::vector<Path> file_watcher::wait_for_changes(std::chrono::milliseconds settle_time)
+{
+    std::vector<Path> changes;
+#ifdef __linux__
+    while(changes.empty())
+        if(!read_events(-1, changes) && inotify_fd < 0) return changes;
+    while(read_events(static_cast<int>(settle_time.count()), changes)) {}
+#else
+    const std::chrono::milliseconds poll_interval(500);
+    while(!compare_snapshot(changes)) std::this_thread::sleep_for(poll_interval);
+    do std::this_thread::sleep_for(settle_time);
+    while(compare_snapshot(changes));
+#endif
+    return changes;
+}
+
+#ifdef __linux__
+
+file_watcher::file_watcher()
+{
+    inotify_fd = inotify_init1(IN_CLOEXEC);
+}
+
+file_watcher::~file_watcher()
+{
+    if(inotify_fd >= 0) ::close(inotify_fd);
+}
+
+bool file_watcher::read_events(int timeout_ms, std::vector<Path> &changes)
+{
+    if(inotify_fd < 0) return false;
+    pollfd pfd = {inotify_fd, POLLIN, 0};
+    if(poll(&pfd, 1, timeout_ms) <= 0) return false;
+
+    alignas(inotify_event) char buffer[1 << 14];
+    const ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+    if(length <= 0) return false;
+    for(ssize_t offset = 0; offset < length;)
+    {
+        const inotify_event *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+        offset += sizeof(inotify_event) + event->len;
+
+        const auto watch = watches.find(event->wd);
+        if(watch == watches.end() || event->len == 0) continue;
+        add_change(directories[watch->second], event->name, changes);
+    }
+    return true;
+}
+
+#else
+
+file_watcher::file_watcher() {}
+file_watcher::~file_watcher() {}
+
+std::map<Path, file_watcher::file_state> file_watcher::take_snapshot() const
+{
+    std::map<Path, file_state> files;
+    boost::system::error_code err;
+    for(const watched_directory &dir : directories)
+    {
+        for(bfs::directory_iterator it(dir.path, err), end; !err && it != end; it.increment(err))
+        {
+            if(!bfs::is_regular_file(it->path(), err)) continue;
+            if(!dir.all_files && !dir.single_files.count(it->path().filename().string())) continue;
+            files[it->path()] = {bfs::last_write_time(it->path(), err), bfs::file_size(it->path(), err)};
+        }
+    }
+    return files;
+}
+
+bool file_watcher::compare_snapshot(std::vector<Path> &changes)
+{
+    std::map<Path, file_state> current = take_snapshot();
+    const size_t changes_before = changes.size();
+    // added or modified files, then removed ones.
+    for(const auto &file : current)
+    {
+        const auto previous = snapshot.find(file.first);
+        if(previous == snapshot.end() || previous->second != file.second)
+            add_change(watch_directory(file.first.parent_path()), file.first.filename().string(), changes);
+    }
+    for(const auto &file : snapshot)
+        if(!current.count(file.first))
+            add_change(watch_directory(file.first.parent_path()), file.first.filename().string(), changes);
+    snapshot = std::move(current);
+    return changes.size() != changes_before;
+}
+
+#endif
+
+} } // namespace inexor::filesystem
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "inexor/filesystem/path.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace inexor { namespace filesystem {
+
+/// Waits for files to change.
+///
+/// Files are watched through their directory, so editors which replace a file by renaming a new one over it
+/// still get noticed. On Linux inotify is used, on other platforms the modification times get polled.
+class file_watcher
+{
+public:
+    file_watcher();
+    ~file_watcher();
+    file_watcher(const file_watcher &) = delete;
+    file_watcher &operator=(const file_watcher &) = delete;
+
+    /// Watch all files in a directory, optionally including the subdirectories (existing ones, at this point).
+    void add_directory(const Path &directory, bool recursive = false);
+
+    /// Watch a single file, wait_for_changes reports it by exactly this path.
+    void add_file(const Path &file);
+
+    /// Blocks until a watched file changed (got modified, added or removed).
+    /// Further changes following shortly (e.g. doxygen rewriting all of its files) get collected as well, until
+    /// there was no change for settle_time.
+    /// @return the changed files, each one once.
+    std::vector<Path> wait_for_changes(std::chrono::milliseconds settle_time = std::chrono::milliseconds(200));
+
+private:
+    struct watched_directory
+    {
+        Path path;
+        /// Whether every file in it is watched, otherwise only single_files are.
+        bool all_files = false;
+        /// The single files watched in it, by file name, with the path they got added by.
+        std::map<std::string, Path> single_files;
+    };
+    std::vector<watched_directory> directories;
+
+    /// Adds the directory (if not yet watched) and returns it.
+    watched_directory &watch_directory(const Path &directory);
+
+    /// Appends the path of a changed file, if it is watched.
+    void add_change(const watched_directory &dir, const std::string &file_name, std::vector<Path> &changes) const;
+
+#ifdef __linux__
+    int inotify_fd = -1;
+    /// The index in directories for each watch descriptor.
+    std::map<int, size_t> watches;
+
+    /// Reads the pending events, waiting up to timeout_ms for the first one (-1 = forever).
+    /// @return false if there was none.
+    bool read_events(int timeout_ms, std::vector<Path> &changes);
+#else
+    struct file_state
+    {
+        std::time_t modified;
+        uintmax_t size;
+        bool operator!=(const file_state &other) const { return modified != other.modified || size != other.size; }
+    };
+    std::map<Path, file_state> snapshot;
+
+    std::map<Path, file_state> take_snapshot() const;
+    /// Takes a new snapshot and appends the differences to the previous one.
+    bool compare_snapshot(std::vector<Path> &changes);
+#endif
+};
+
+} } // namespace inexor::filesystem
@@ -1,8 +1,22 @@
 
 #include <fstream>
 #include <vector>
+#include <cstring>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include "inexor/filesystem/path.hpp"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace bfs = boost::filesystem;
 
 namespace inexor { namespace filesystem {
@@ -50,4 +64,413 @@ std::vector<Path> &list_files(Path folder, std::vector<Path> &file_list, Path ex
     return file_list;
 }
 
+static bool glob_match(const char *pattern, const char *path)
+{
+    while(*pattern)
+    {
+        if(*pattern == '*')
+        {
+            const bool any_depth = pattern[1] == '*';
+            pattern += any_depth ? 2 : 1;
+            // "**/" also matches no directory at all.
+            if(any_depth && *pattern == '/' && glob_match(pattern + 1, path)) return true;
+            for(;; path++)
+            {
+                if(glob_match(pattern, path)) return true;
+                if(!*path || (!any_depth && *path == '/')) return false;
+            }
+        }
+        if(!*path || (*pattern == '?' ? *path == '/' : *pattern != *path)) return false;
+        pattern++;
+        path++;
+    }
+    return !*path;
+}
+
+bool glob_match(const std::string &pattern, const std::string &path)
+{
+    return glob_match(pattern.c_str(), path.c_str());
+}
+
+/// The state shared by the threads of walk_directory.
+struct directory_walk
+{
+    const Path &root;
+    const std::function<void(const Path &)> &on_file;
+    const std::vector<std::string> &include, &exclude;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    /// The directories (relative to the root, '/' separated) waiting to be listed.
+    std::vector<std::string> pending{std::string()};
+    /// How many directories are getting listed right now.
+    size_t busy = 0;
+
+    directory_walk(const Path &root, const std::function<void(const Path &)> &on_file,
+                   const std::vector<std::string> &include, const std::vector<std::string> &exclude)
+        : root(root), on_file(on_file), include(include), exclude(exclude) {}
+
+    static bool matches_any(const std::vector<std::string> &globs, const std::string &relative, const std::string &name)
+    {
+        for(const std::string &glob : globs)
+            if(glob_match(glob, glob.find('/') != std::string::npos ? relative : name)) return true;
+        return false;
+    }
+
+    void add_entry(const std::string &relative, const std::string &name, bool is_directory,
+                   std::vector<std::string> &subdirectories)
+    {
+        if(matches_any(exclude, relative, name)) return;
+        if(is_directory) subdirectories.push_back(relative);
+        else if(include.empty() || matches_any(include, relative, name)) on_file(root / relative);
+    }
+
+    /// Lists a single directory, reporting its files and returning its subdirectories.
+    void list(const std::string &directory, std::vector<std::string> &subdirectories)
+    {
+        const Path path = directory.empty() ? root : root / directory;
+        const std::string prefix = directory.empty() ? directory : directory + "/";
+#ifdef _WIN32
+        // the status of the entries is cached from the listing on windows.
+        boost::system::error_code err;
+        for(bfs::directory_iterator it(path, err), end; !err && it != end; it.increment(err))
+        {
+            const bfs::file_status status = it->symlink_status(err);
+            if(err) continue;
+            const std::string name = it->path().filename().string();
+            if(bfs::is_directory(status)) add_entry(prefix + name, name, true, subdirectories);
+            else if(bfs::is_regular_file(status) || (bfs::is_symlink(status) && bfs::is_regular_file(it->status(err))))
+                add_entry(prefix + name, name, false, subdirectories);
+        }
+#else
+        DIR *dir = opendir(path.c_str());
+        if(!dir) return;
+        while(const dirent *entry = readdir(dir))
+        {
+            const char *name = entry->d_name;
+            if(std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) continue;
+
+            unsigned char type = entry->d_type;
+            struct stat st;
+            if(type == DT_UNKNOWN)
+            {
+                // lstat, so a symlink to a directory does not look like one.
+                if(lstat((path / name).c_str(), &st) != 0) continue;
+                if(S_ISREG(st.st_mode)) type = DT_REG;
+                else if(S_ISDIR(st.st_mode)) type = DT_DIR;
+                else if(S_ISLNK(st.st_mode)) type = DT_LNK;
+                else continue;
+            }
+            if(type == DT_LNK)
+            {
+                // symlinks get followed to files only, like boost::filesystem::recursive_directory_iterator does.
+                if(stat((path / name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+                type = DT_REG;
+            }
+            if(type == DT_DIR) add_entry(prefix + name, name, true, subdirectories);
+            else if(type == DT_REG) add_entry(prefix + name, name, false, subdirectories);
+        }
+        closedir(dir);
+#endif
+    }
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true)
+        {
+            wakeup.wait(lock, [this] { return !pending.empty() || busy == 0; });
+            if(pending.empty()) return; // nothing left and nobody listing a directory which could add more.
+
+            const std::string directory = std::move(pending.back());
+            pending.pop_back();
+            busy++;
+            lock.unlock();
+
+            std::vector<std::string> subdirectories;
+            list(directory, subdirectories);
+
+            lock.lock();
+            busy--;
+            for(std::string &subdirectory : subdirectories) pending.push_back(std::move(subdirectory));
+            wakeup.notify_all();
+        }
+    }
+};
+
+void walk_directory(const Path &folder, const std::function<void(const Path &file)> &on_file,
+                    const std::vector<std::string> &include, const std::vector<std::string> &exclude, size_t jobs)
+{
+    boost::system::error_code err;
+    if(!bfs::is_directory(folder, err)) return;
+
+    directory_walk walk(folder, on_file, include, exclude);
+    if(jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < jobs; i++)
+        threads.emplace_back([&walk] { walk.work(); });
+    walk.work(); // the calling thread walks as well.
+    for(std::thread &thread : threads)
+        thread.join();
+}
+
+bool write_file_atomically(const Path &file, const char *data, size_t size)
+{
+    Path temporary = file;
+    temporary += bfs::unique_path(".%%%%-%%%%-%%%%.tmp");
+    {
+        std::ofstream sink(temporary.string(), std::ofstream::binary | std::ofstream::trunc);
+        sink.write(data, size);
+        if(!sink) return false;
+    }
+    boost::system::error_code err;
+    bfs::rename(temporary, file, err);
+    if(!err) return true;
+    bfs::remove(temporary, err);
+    return false;
+}
+
+bool mapped_file::read_into_memory = false;
+
+mapped_file::mapped_file(const Path &file)
+{
+    open(file);
+}
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+mapped_file::mapped_file(mapped_file &&other)
+    : contents(other.contents), length(other.length), opened(other.opened), copied(other.copied)
+{
+    other.contents = nullptr;
+    other.length = 0;
+    other.opened = false;
+    other.copied = false;
+}
+
+mapped_file &mapped_file::operator=(mapped_file &&other)
+{
+    if(this == &other) return *this;
+    close();
+    std::swap(contents, other.contents);
+    std::swap(length, other.length);
+    std::swap(opened, other.opened);
+    std::swap(copied, other.copied);
+    return *this;
+}
+
+bool mapped_file::read_contents(const Path &file)
+{
+    std::ifstream in(file.string(), std::ios::binary | std::ios::ate);
+    if(!in) return false;
+    const std::streamoff size = in.tellg();
+    if(size < 0) return false;
+    opened = true;
+    if(size == 0) return true;
+
+    contents = new char[static_cast<size_t>(size)];
+    copied = true;
+    in.seekg(0);
+    in.read(contents, size);
+    // less than expected if the file got truncated meanwhile.
+    length = static_cast<size_t>(in.gcount());
+    return true;
+}
+
+#ifdef _WIN32
+bool mapped_file::open(const Path &file)
+{
+    close();
+    if(read_into_memory) return read_contents(file);
+    HANDLE file_handle = CreateFileW(file.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                     OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file_handle == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER file_size;
+    if(!GetFileSizeEx(file_handle, &file_size))
+    {
+        CloseHandle(file_handle);
+        return false;
+    }
+    if(file_size.QuadPart == 0) // empty files can not be mapped.
+    {
+        CloseHandle(file_handle);
+        opened = true;
+        return true;
+    }
+
+    HANDLE mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(file_handle);
+    if(!mapping_handle) return false;
+
+    // the view keeps the mapping alive, we do not need the handle anymore.
+    void *view = MapViewOfFile(mapping_handle, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping_handle);
+    if(!view) return false;
+
+    contents = static_cast<char *>(view);
+    length = static_cast<size_t>(file_size.QuadPart);
+    opened = true;
+    return true;
+}
+
+void mapped_file::close()
+{
+    if(copied) delete[] contents;
+    else if(contents) UnmapViewOfFile(contents);
+    contents = nullptr;
+    length = 0;
+    opened = false;
+    copied = false;
+}
+#else
+bool mapped_file::open(const Path &file)
+{
+    close();
+    if(read_into_memory) return read_contents(file);
+    const int fd = ::open(file.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    if(file_stat.st_size == 0) // empty files can not be mapped.
+    {
+        ::close(fd);
+        opened = true;
+        return true;
+    }
+
+    // the mapping stays valid after closing the file descriptor.
+    void *view = mmap(nullptr, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(view == MAP_FAILED) return false;
+    madvise(view, file_stat.st_size, MADV_SEQUENTIAL);
+
+    contents = static_cast<char *>(view);
+    length = static_cast<size_t>(file_stat.st_size);
+    opened = true;
+    return true;
+}
+
+void mapped_file::close()
+{
+    if(copied) delete[] contents;
+    else if(contents) munmap(contents, length);
+    contents = nullptr;
+    length = 0;
+    opened = false;
+    copied = false;
+}
+#endif
+
+file_update_stream::update_buf::update_buf(const Path &file) : target(file), existing(file)
+{
+    setp(buffer, buffer + sizeof(buffer));
+    if(!existing.is_open()) diverge(); // there is nothing to compare to.
+}
+
+file_update_stream::update_buf::~update_buf()
+{
+    // not committed: never leave a temporary file behind.
+    if(!sink.is_open()) return;
+    sink.close();
+    boost::system::error_code err;
+    bfs::remove(temporary, err);
+}
+
+void file_update_stream::update_buf::diverge()
+{
+    diverged = true;
+    temporary = target;
+    temporary += bfs::unique_path(".%%%%-%%%%-%%%%.tmp");
+    sink.open(temporary.string(), std::ofstream::binary | std::ofstream::trunc);
+    if(equal_bytes) sink.write(existing.data(), equal_bytes);
+    if(!sink) failed = true;
+}
+
+void file_update_stream::update_buf::process(const char *data, size_t size)
+{
+    if(failed || size == 0) return;
+    if(!diverged)
+    {
+        if(existing.size() - equal_bytes >= size && std::memcmp(existing.data() + equal_bytes, data, size) == 0)
+        {
+            equal_bytes += size;
+            return;
+        }
+        diverge();
+    }
+    sink.write(data, size);
+    if(!sink) failed = true;
+}
+
+bool file_update_stream::update_buf::flush_buffer()
+{
+    process(pbase(), pptr() - pbase());
+    setp(buffer, buffer + sizeof(buffer));
+    return !failed;
+}
+
+file_update_stream::update_buf::int_type file_update_stream::update_buf::overflow(int_type c)
+{
+    if(!flush_buffer()) return traits_type::eof();
+    if(!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int file_update_stream::update_buf::sync()
+{
+    return flush_buffer() ? 0 : -1;
+}
+
+bool file_update_stream::update_buf::commit(bool &changed)
+{
+    changed = false;
+    if(!flush_buffer()) return false;
+    // the new contents are the beginning of the existing ones, but shorter.
+    if(!diverged && equal_bytes != existing.size()) diverge();
+    existing.close(); // some platforms can not replace a file which is still mapped.
+    if(!diverged) return true;
+
+    sink.close();
+    if(failed || !sink)
+    {
+        boost::system::error_code err;
+        bfs::remove(temporary, err);
+        return false;
+    }
+    boost::system::error_code err;
+    bfs::rename(temporary, target, err);
+    if(err)
+    {
+        bfs::remove(temporary, err);
+        return false;
+    }
+    changed = true;
+    return true;
+}
+
+file_update_stream::result file_update_stream::commit()
+{
+    bool changed = false;
+    if(!buf.commit(changed))
+    {
+        setstate(std::ios_base::badbit);
+        return FAILED;
+    }
+    return changed ? WRITTEN : UNCHANGED;
+}
+
 } } // ns inexor::filesystem
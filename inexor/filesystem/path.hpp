@@ -2,6 +2,10 @@
 
 #include <vector>
 #include <string>
+#include <functional>
+#include <fstream>
+#include <ostream>
+#include <streambuf>
 
 #include <boost/filesystem.hpp>
 
@@ -23,5 +27,124 @@ extern const std::string filecontents_partly(const std::string &filename, size_t
 /// Retrieve a list of all files inside a folder (non recursively!).
 /// @param ext needs to be either empty or an extension to filter for (only those files get accepted) DOT needed! ".jpg"
 extern std::vector<Path> &list_files(Path folder, std::vector<Path> &file_list, Path ext);
+
+/// Returns true if the glob pattern matches the path ('/' separated).
+/// '*' matches anything but '/', '**' anything (with "**/" matching no directory as well) and '?' a single char.
+extern bool glob_match(const std::string &pattern, const std::string &path);
+
+/// Calls on_file for every regular file below the folder (recursively).
+///
+/// The subdirectories get listed by up to jobs threads (0 = one per hardware thread), so on_file gets called
+/// concurrently and in no particular order. It must not throw.
+/// The type of each entry comes from the directory listing itself, only if the file system does not provide it
+/// (or for symlinks) the entry gets stat'ed. Symlinks to directories are not followed.
+/// @param include if not empty, only files matching one of these globs get reported.
+/// @param exclude neither files nor directories (with everything inside them) matching one of these get reported.
+/// Globs containing a '/' get matched against the path relative to the folder, all others against the file name.
+extern void walk_directory(const Path &folder, const std::function<void(const Path &file)> &on_file,
+                           const std::vector<std::string> &include = std::vector<std::string>(),
+                           const std::vector<std::string> &exclude = std::vector<std::string>(),
+                           size_t jobs = 1);
+
+/// Replace the contents of a file atomically.
+///
+/// The data gets written to a temporary file next to it, which gets renamed to the target afterwards.
+/// Concurrent readers hence either see the old or the new file, never a partially written one.
+/// Returns false if writing failed (the target is left untouched in this case).
+extern bool write_file_atomically(const Path &file, const char *data, size_t size);
+
+/// The contents of a file, mapped into memory instead of being copied into a buffer.
+///
+/// The mapping is private (copy-on-write): the pages can be modified by us (e.g. by in-situ parsers like
+/// pugi::xml_document::load_buffer_inplace) but no change ever gets written back to the file.
+/// Only the pages we actually write to get copied, all others stay shared with the OS file cache.
+class mapped_file
+{
+    char *contents = nullptr;
+    size_t length = 0;
+    bool opened = false;
+    /// Whether contents got read into memory instead of being mapped, see read_into_memory.
+    bool copied = false;
+
+    bool read_contents(const Path &file);
+
+public:
+    /// If set, the files get read into memory instead of being mapped.
+    /// Accessing the mapping of a file which gets truncated meanwhile (e.g. rewritten by doxygen while we watch it)
+    /// crashes with SIGBUS, a file read into memory instead just ends early.
+    static bool read_into_memory;
+
+    mapped_file() {}
+    /// Maps the file (or reads it, see read_into_memory), check is_open() afterwards.
+    explicit mapped_file(const Path &file);
+    ~mapped_file();
+
+    mapped_file(mapped_file &&other);
+    mapped_file &operator=(mapped_file &&other);
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    /// Maps the file (unmapping the previous one). Returns false if it could not be opened.
+    bool open(const Path &file);
+    void close();
+
+    /// Whether a file is mapped. Empty files are open as well, but have no data().
+    bool is_open() const { return opened; }
+    char *data() { return contents; }
+    const char *data() const { return contents; }
+    size_t size() const { return length; }
+};
+
+/// An output stream replacing the contents of a file, but only if they change.
+///
+/// Whatever gets written is compared chunk by chunk against the current contents of the file.
+/// Only when the first difference shows up, the new contents start going to a temporary file next to it.
+/// commit() then either leaves the file untouched (same contents, its mtime does not change) or renames the temporary
+/// file to it, see write_file_atomically.
+/// So the new contents never need to be kept in memory as a whole.
+class file_update_stream : public std::ostream
+{
+    class update_buf : public std::streambuf
+    {
+        Path target;
+        mapped_file existing;
+        /// How many bytes we got so far, as long as those equal the beginning of the existing file.
+        size_t equal_bytes = 0;
+        bool diverged = false;
+        bool failed = false;
+        Path temporary;
+        std::ofstream sink;
+        char buffer[1 << 16];
+
+        /// Compares (or writes) a chunk of the new contents.
+        void process(const char *data, size_t size);
+        /// Start writing to the temporary file, beginning with the part identical to the existing file.
+        void diverge();
+        bool flush_buffer();
+
+    protected:
+        int_type overflow(int_type c) override;
+        int sync() override;
+
+    public:
+        explicit update_buf(const Path &file);
+        ~update_buf();
+        bool commit(bool &changed);
+    };
+    update_buf buf;
+
+public:
+    enum result
+    {
+        UNCHANGED,
+        WRITTEN,
+        FAILED
+    };
+
+    explicit file_update_stream(const Path &file) : std::ostream(nullptr), buf(file) { rdbuf(&buf); }
+
+    /// Finishes writing, nothing should be written afterwards.
+    result commit();
+};
 } } // ns inexor::filesystem
 
@@ -1,10 +1,19 @@
 
 #include "inexor/gluegen/ASTs.hpp"
+#include "inexor/gluegen/parallel.hpp"
+#include "inexor/gluegen/marker_prescan.hpp"
+#include "inexor/gluegen/extraction_cache.hpp"
+#include "inexor/gluegen/stage_timings.hpp"
+#include "inexor/gluegen/source_scanner.hpp"
 
 #include <boost/algorithm/string.hpp>
 
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <set>
 
 using namespace std;
 using namespace pugi;
@@ -27,51 +36,568 @@ bool is_option_class_node(const xml_node &class_compound_xml)
     return false;
 }
 
-void ASTs::load_from_directory(const Path &directory)
+/// What a single xml file turned out to be, after loading it.
+enum ast_file_kind
 {
-    std::vector<Path> all_xml_file_names;
-    list_files(directory, all_xml_file_names, ".xml");
-    for(auto &file : all_xml_file_names)
+    AST_FILE_IGNORED,
+    AST_FILE_UNPARSEABLE,
+    AST_FILE_WITHOUT_MARKER, ///< A code AST, which we did not parse since the prescan did not find any reflection marker.
+    AST_FILE_EXTRACTED,
+    AST_FILE_CACHED          ///< The extract got loaded from the extraction cache, we did not parse the file.
+};
+
+struct loaded_ast_file
+{
+    ast_file_kind kind = AST_FILE_IGNORED;
+    AST_file_extract extract;
+    uint64_t cache_key = 0;
+    size_t file_size = 0;
+    /// The file stays mapped as long as xml needs it.
+    mapped_file buffer;
+    /// Only kept for attribute classes, which get extracted on the calling thread (see below).
+    ASTs::xml_document_ptr xml;
+    /// How long parsing (or prescanning) the file took.
+    std::chrono::steady_clock::duration duration{0};
+};
+
+/// The order the xml files get loaded (and their extracts merged) in.
+/// By name since the listing order differs between platforms (and file systems) and the output should not,
+/// this is the same order load_from_shards merges the files in.
+static bool load_order_less(const Path &a, const Path &b)
+{
+    const int by_name = a.filename().compare(b.filename());
+    return by_name != 0 ? by_name < 0 : a < b;
+}
+
+/// Lists the xml files below the directory (doxygen output trees can be nested).
+static void list_xml_files(const Path &directory, size_t jobs, std::vector<Path> &files)
+{
+    files.clear();
+    std::mutex files_mutex;
+    walk_directory(directory, [&](const Path &file)
+    {
+        std::lock_guard<std::mutex> lock(files_mutex);
+        files.push_back(file);
+    }, {"*.xml"}, {}, jobs);
+
+    for(Path &file : files) file.make_preferred();
+    std::sort(files.begin(), files.end(), load_order_less);
+}
+
+void ASTs::load_from_directory(const Path &directory, size_t jobs, const std::vector<std::string> &reflection_markers,
+                               const Path &cache_directory)
+{
+    file_extracts.clear();
+    indexed_classes.clear();
+    classes_on_demand = false;
+    list_xml_files(directory, jobs, listed_files);
+
+    load_files(listed_files, {}, jobs, reflection_markers, cache_directory);
+    merge_file_extracts();
+}
+
+void ASTs::update_from_directory(const Path &directory, const std::vector<Path> &changed_files, size_t jobs,
+                                 const std::vector<std::string> &reflection_markers, const Path &cache_directory)
+{
+    // list them again for the order and for new files.
+    list_xml_files(directory, jobs, listed_files);
+
+    std::vector<Path> files_to_load;
+    for(Path file : changed_files)
     {
         file.make_preferred();
+        file_extracts.erase(file.string());
+        if(std::find(listed_files.begin(), listed_files.end(), file) != listed_files.end())
+            files_to_load.push_back(file);
+    }
+    load_files(files_to_load, {}, jobs, reflection_markers, cache_directory);
+    merge_file_extracts();
+}
 
-        // handle code ASTs
-        if(contains(file.filename().string(), "_8cpp.xml") || contains(file.filename().string(), "_8hpp.xml")
-           || contains(file.filename().string(), "namespace"))// cpp/hpp files for namespaced contents
+bool ASTs::load_from_index(const Path &directory, size_t jobs, const std::vector<std::string> &reflection_markers,
+                           const Path &cache_directory)
+{
+    Path index_file = directory / "index.xml";
+    index_file.make_preferred();
+    xml_document index;
+    if(!index.load_file(index_file.c_str())) return false;
+
+    // the refids of the index resolve to files next to it, the compounds of nested trees are not listed at all.
+    std::vector<Path> xml_files;
+    list_xml_files(directory, jobs, xml_files);
+    for(const Path &file : xml_files)
+        if(file.parent_path() != index_file.parent_path())
         {
-            auto xml = make_unique<xml_document>();
-            if(load_xml_file(file, xml)) code_xmls.push_back(std::move(xml));
-            continue;
+            std::cout << "The doxygen AST folder is nested, loading all of its files instead of using the index" << std::endl;
+            return false;
         }
 
-        if(!contains(file.stem().string(), "class") && !contains(file.stem().string(), "struct"))
-            continue;
-        // handle class ASTs:
-        // either a SharedOption (remember it by classname) or just remember the class AST by its refid (doxygens reference ID)
+    file_extracts.clear();
+    indexed_classes.clear();
+    index_reflection_markers = reflection_markers;
+    index_cache_directory = cache_directory;
+
+    // the same files (in the same order) load_from_directory considers, but by their kind instead of their name.
+    std::vector<std::pair<Path, file_role>> files;
+    for(const xml_node &compound : index.child("doxygenindex").children("compound"))
+    {
+        const string refid = compound.attribute("refid").value();
+        const string kind = compound.attribute("kind").value();
+        if(refid.empty()) continue;
+        Path file = directory / (refid + ".xml");
+        file.make_preferred();
+
+        if(kind == "class" || kind == "struct")
+        {
+            indexed_classes[refid] = file;
+            files.emplace_back(file, ROLE_OPTION_CLASS);
+        }
+        else if(kind == "namespace") files.emplace_back(file, ROLE_CODE);
+        else if(kind == "file")
+        {
+            const string ext = Path(compound.child_value("name")).extension().string();
+            if(ext == ".cpp" || ext == ".hpp") files.emplace_back(file, ROLE_CODE);
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const std::pair<Path, file_role> &a, const std::pair<Path, file_role> &b)
+    {
+        return load_order_less(a.first, b.first);
+    });
+
+    listed_files.clear();
+    std::vector<file_role> roles;
+    for(const auto &file : files)
+    {
+        listed_files.push_back(file.first);
+        roles.push_back(file.second);
+    }
+    load_files(listed_files, roles, jobs, reflection_markers, cache_directory);
+
+    // only the classes not loaded yet can be loaded on demand.
+    const size_t class_count = indexed_classes.size();
+    for(auto indexed = indexed_classes.begin(); indexed != indexed_classes.end();)
+    {
+        if(file_extracts.count(indexed->second.string())) indexed = indexed_classes.erase(indexed);
+        else ++indexed;
+    }
+    classes_on_demand = true;
+    merge_file_extracts();
+    std::cout << "Loaded " << (class_count - indexed_classes.size()) << " of " << class_count
+              << " class ASTs listed in the index, the others get loaded on demand" << std::endl;
+    return true;
+}
+
+void ASTs::load_class_compounds(const std::vector<std::string> &refids, size_t jobs)
+{
+    std::vector<Path> files;
+    for(const string &refid : refids)
+    {
+        // each file gets loaded once, even if it does not contain a class we could use.
+        const auto indexed = indexed_classes.find(refid);
+        if(indexed == indexed_classes.end()) continue;
+        files.push_back(indexed->second);
+        indexed_classes.erase(indexed);
+    }
+    if(files.empty()) return;
+
+    const std::vector<file_role> roles(files.size(), ROLE_CLASS);
+    load_files(files, roles, jobs, index_reflection_markers, index_cache_directory);
+
+    // the class_compounds passed to find_class_definitions get extended, so the existing entries must stay untouched.
+    for(const Path &file : files)
+    {
+        auto extract = file_extracts.find(file.string());
+        if(extract == file_extracts.end()) continue;
+        if(extract->second.kind == AST_file_extract::CLASS && !class_compounds.count(extract->second.compound.refid))
+        {
+            if(keep_file_extracts) add_extract(AST_file_extract(extract->second));
+            else add_extract(std::move(extract->second));
+        }
+        if(keep_file_extracts) listed_files.push_back(file);
+        else file_extracts.erase(extract);
+    }
+}
+
+void ASTs::load_files(const std::vector<Path> &files, const std::vector<file_role> &roles, size_t jobs,
+                      const std::vector<std::string> &reflection_markers, const Path &cache_directory)
+{
+    typedef std::chrono::steady_clock clock;
+    const marker_prescanner prescanner(reflection_markers);
+    const marker_prescanner option_prescanner(std::vector<std::string>{"SharedOption"});
+    const extraction_cache cache(cache_directory, reflection_markers);
+
+    // Every file gets its own result slot, so the parsing threads do not share anything.
+    std::vector<loaded_ast_file> loaded_files(files.size());
+
+    parallel_for(files.size(), jobs, [&](size_t i)
+    {
+        const Path &file = files[i];
+        loaded_ast_file &loaded = loaded_files[i];
+
+        const file_role role = roles.empty() ? ROLE_BY_NAME : roles[i];
+        bool is_code_file = role == ROLE_CODE;
+        if(role == ROLE_BY_NAME)
+        {
+            // handle code ASTs
+            is_code_file = contains(file.filename().string(), "_8cpp.xml") || contains(file.filename().string(), "_8hpp.xml")
+                           || contains(file.filename().string(), "namespace"); // cpp/hpp files for namespaced contents
+
+            // handle class ASTs:
+            // either a SharedOption (remember it by classname) or just remember the class AST by its refid (doxygens reference ID)
+            if(!is_code_file && !contains(file.stem().string(), "class") && !contains(file.stem().string(), "struct"))
+                return;
+        }
+
+        stage_timings::detail_scope trace("parse_ast_file", file.filename().string());
+        const clock::time_point start = clock::now();
+        if(!loaded.buffer.open(file))
+        {
+            loaded.kind = AST_FILE_UNPARSEABLE;
+            return;
+        }
+        loaded.file_size = loaded.buffer.size();
+        // only files containing a reflection marker can contain anything find_shared_var_occurences is looking for.
+        if(is_code_file && !prescanner.contains_marker(loaded.buffer.data(), loaded.buffer.size()))
+        {
+            loaded.kind = AST_FILE_WITHOUT_MARKER;
+            loaded.duration = clock::now() - start;
+            loaded.buffer.close();
+            return;
+        }
+        // the other classes get loaded on demand.
+        if(role == ROLE_OPTION_CLASS && !option_prescanner.contains_marker(loaded.buffer.data(), loaded.buffer.size()))
+        {
+            loaded.kind = AST_FILE_IGNORED;
+            loaded.buffer.close();
+            return;
+        }
+
+        if(cache.is_enabled())
+        {
+            loaded.cache_key = cache.key_of(loaded.buffer.data(), loaded.buffer.size());
+            if(cache.load(loaded.cache_key, loaded.extract))
+            {
+                loaded.kind = AST_FILE_CACHED;
+                loaded.buffer.close();
+                return;
+            }
+        }
 
         auto xml = make_unique<xml_document>();
-        if(!load_xml_file(file, xml)) continue;
+        if(!parse_xml_buffer(loaded.buffer, xml))
+        {
+            loaded.kind = AST_FILE_UNPARSEABLE;
+            return;
+        }
+        loaded.kind = AST_FILE_EXTRACTED;
 
         const xml_node compound_xml = xml->child("doxygen").child("compounddef"); //[@kind='class' and @language='C++']");
+        if(is_code_file)
+        {
+            loaded.extract.kind = AST_file_extract::CODE;
+            find_shared_var_occurences(compound_xml, loaded.extract.shared_vars);
+        }
+        else if(is_option_class_node(compound_xml))
+        {
+            // parsing attributes prints what it finds, so we do it on the calling thread in listing order.
+            loaded.extract.kind = AST_file_extract::ATTRIBUTE_CLASS;
+            loaded.xml = std::move(xml);
+            return;
+        }
+        else
+        {
+            loaded.extract.kind = AST_file_extract::CLASS;
+            loaded.extract.compound = parse_class_compound(compound_xml);
+        }
+        loaded.duration = clock::now() - start;
+        if(cache.is_enabled()) cache.store(loaded.cache_key, loaded.extract);
+        xml.reset();
+        loaded.buffer.close();
+    });
+
+    // Statistics about the prescan, we estimate the time saved by the average parse speed of the files we did parse.
+    size_t skipped_files = 0, skipped_bytes = 0, parsed_code_files = 0, parsed_code_bytes = 0;
+    clock::duration prescan_time{0}, code_parse_time{0};
+    size_t cached_files = 0, extracted_files = 0;
+    size_t loaded_files_count = 0, loaded_bytes = 0;
+
+    // Attribute classes get extracted in listing order, so the output is the same as when loading them on a single thread.
+    for(size_t i = 0; i < loaded_files.size(); i++)
+    {
+        loaded_ast_file &loaded = loaded_files[i];
+        if(loaded.kind != AST_FILE_IGNORED)
+        {
+            loaded_files_count++;
+            loaded_bytes += loaded.file_size;
+        }
+        switch(loaded.kind)
+        {
+            case AST_FILE_IGNORED:
+                break;
+            case AST_FILE_WITHOUT_MARKER:
+                skipped_files++;
+                skipped_bytes += loaded.file_size;
+                prescan_time += loaded.duration;
+                break;
+            case AST_FILE_UNPARSEABLE:
+                std::cout << "XML file representing the AST couldn't be parsed: " << files[i] << std::endl;
+                break;
+            case AST_FILE_CACHED:
+                cached_files++;
+                file_extracts[files[i].string()] = std::move(loaded.extract);
+                break;
+            case AST_FILE_EXTRACTED:
+                extracted_files++;
+                if(loaded.xml)
+                {
+                    const xml_node compound_xml = loaded.xml->child("doxygen").child("compounddef");
+                    loaded.extract.attribute = parse_shared_attribute_definition(compound_xml);
+                    if(cache.is_enabled()) cache.store(loaded.cache_key, loaded.extract);
+                }
+                if(loaded.extract.kind == AST_file_extract::CODE)
+                {
+                    parsed_code_files++;
+                    parsed_code_bytes += loaded.file_size;
+                    code_parse_time += loaded.duration;
+                }
+                file_extracts[files[i].string()] = std::move(loaded.extract);
+                break;
+        }
+    }
+
+    if(stage_timings::tracing)
+    {
+        stage_timings::tracing->add_counter_sample("ast_files_loaded", static_cast<double>(loaded_files_count));
+        stage_timings::tracing->add_counter_sample("ast_bytes_read", static_cast<double>(loaded_bytes));
+    }
+    if(prescanner.is_enabled())
+    {
+        using std::chrono::milliseconds;
+        using std::chrono::duration_cast;
+        const double saved_ms = parsed_code_bytes == 0 ? 0.0 :
+            duration_cast<milliseconds>(code_parse_time).count() * double(skipped_bytes) / parsed_code_bytes;
+        std::cout << "Skipped " << skipped_files << " of " << (skipped_files + parsed_code_files)
+                  << " parsed code AST files without reflection marker (prescanning took "
+                  << duration_cast<milliseconds>(prescan_time).count() << "ms, saved about "
+                  << static_cast<long long>(saved_ms) << "ms of parsing)" << std::endl;
+    }
+    if(cache.is_enabled())
+        std::cout << "Loaded " << cached_files << " of " << (cached_files + extracted_files)
+                  << " AST files from the extraction cache (" << cache_directory << ")" << std::endl;
+}
+
+/// Returns true for C++ source files, false for headers and any other file.
+static bool is_source_file(const Path &file)
+{
+    const string ext = file.extension().string();
+    return ext == ".cpp" || ext == ".cc" || ext == ".cxx" || ext == ".c";
+}
 
-        if(is_option_class_node(compound_xml)) {
-            attribute_class_xmls.push_back(std::move(xml));
+static bool is_header_file(const Path &file)
+{
+    const string ext = file.extension().string();
+    return ext == ".hpp" || ext == ".hh" || ext == ".hxx" || ext == ".h";
+}
+
+void ASTs::load_from_sources(const Path &directory, size_t jobs, const std::vector<std::string> &reflection_markers)
+{
+    const marker_prescanner prescanner(reflection_markers);
+
+    std::vector<Path> files;
+    std::mutex files_mutex;
+    walk_directory(directory, [&](const Path &file)
+    {
+        if(!is_source_file(file) && !is_header_file(file)) return;
+        std::lock_guard<std::mutex> lock(files_mutex);
+        files.push_back(file);
+    }, {}, {}, jobs);
+    // the listing order differs between platforms, the output should not.
+    std::sort(files.begin(), files.end());
+
+    std::vector<scanned_source_file> scanned(files.size());
+    std::vector<char> unreadable(files.size(), 0);
+    parallel_for(files.size(), jobs, [&](size_t i)
+    {
+        stage_timings::detail_scope trace("scan_source_file", files[i].filename().string());
+        mapped_file buffer(files[i]);
+        if(!buffer.is_open())
+        {
+            unreadable[i] = 1;
+            return;
         }
-        else {
-            class_xmls[compound_xml.attribute("id").value()] = std::move(xml);
+        // classes are needed even without marked members (they are the types of the variables), hence headers
+        // always get scanned, just as the class ASTs always get parsed.
+        if(is_source_file(files[i]) && !prescanner.contains_marker(buffer.data(), buffer.size()))
+            return;
+        const string header = files[i].lexically_relative(directory).generic_string();
+        scan_source(buffer.data(), buffer.size(), header, scanned[i]);
+    });
+
+    // Merge them in listing order, attribute definitions print what they find, so that happens here as well.
+    for(size_t i = 0; i < files.size(); i++)
+    {
+        if(unreadable[i])
+        {
+            std::cout << "Source file couldn't be opened: " << files[i] << std::endl;
+            continue;
+        }
+        for(SharedVariable &var : scanned[i].shared_vars)
+            shared_var_occurences.push_back(std::move(var));
+        for(class_compound &compound : scanned[i].classes)
+        {
+            const string refid = compound.refid;
+            class_compounds[refid] = std::move(compound);
         }
+        for(const scanned_attribute_class &attribute : scanned[i].attribute_classes)
+            attribute_definitions[attribute.name] = new_shared_attribute_definition(attribute.name, attribute.constructors);
+    }
+
+    // only now all classes are known.
+    resolve_scanned_types(class_compounds, shared_var_occurences);
+    for(auto &compound : class_compounds)
+        resolve_scanned_types(class_compounds, compound.second);
+}
+
+bool ASTs::parse_xml_buffer(mapped_file &buffer, unique_ptr<xml_document>& xml)
+{
+    // parse the mapped pages in-situ: node strings point into the buffer instead of getting copied.
+    return xml->load_buffer_inplace(buffer.data(), buffer.size(), parse_default|parse_trim_pcdata);
+}
+
+/// Increase this whenever the layout of the shard file changes.
+static const uint32_t shard_format_version = 1;
+static const char shard_magic[4] = {'I', 'G', 'G', 'S'};
+
+bool ASTs::write_shard(const Path &file, const std::vector<std::string> &reflection_markers) const
+{
+    record_writer out;
+    out.write_header(shard_magic, shard_format_version);
+    out.write_string(gluegen_version);
+    out.write_strings(reflection_markers);
+
+    size_t count = 0;
+    for(const Path &listed : listed_files) count += file_extracts.count(listed.string());
+    out.write_u32(static_cast<uint32_t>(count));
+    for(const Path &listed : listed_files)
+    {
+        const auto extract = file_extracts.find(listed.string());
+        if(extract == file_extracts.end()) continue;
+        // only the name, the shards get merged as if their files were in one folder.
+        out.write_string(listed.filename().string());
+        write_extract(out, extract->second);
     }
+    return write_file_atomically(file, out.buffer.data(), out.buffer.size());
 }
 
-bool ASTs::load_xml_file(const Path &file, unique_ptr<xml_document>& xml)
+/// Adds what another shard extracted from a file with the same name to the extract.
+/// Doxygen names the ASTs after what they document, so each module's run writes e.g. its own namespaceinexor.xml
+/// (or config_8hpp.xml), containing only the variables of that module. Their variables get united, a variable
+/// seen by several modules (e.g. declared in a shared header) counts once. Class ASTs of the same name describe the
+/// same class, the first one is kept.
+static void merge_shard_extract(AST_file_extract &existing, AST_file_extract &&extract)
 {
-    if(!xml->load_file(file.c_str(), parse_default|parse_trim_pcdata))
+    if(existing.kind == AST_file_extract::NOTHING)
     {
-        std::cout << "XML file representing the AST couldn't be parsed: " << file << std::endl;
-        return false;
+        existing = std::move(extract);
+        return;
+    }
+    if(existing.kind != AST_file_extract::CODE || extract.kind != AST_file_extract::CODE) return;
+
+    std::set<std::pair<std::vector<string>, string>> known;
+    for(const SharedVariable &var : existing.shared_vars) known.emplace(var.var_namespace, var.name);
+    for(const SharedVariable &var : extract.shared_vars)
+        if(known.emplace(var.var_namespace, var.name).second) existing.shared_vars.push_back(var);
+}
+
+bool ASTs::load_from_shards(const std::vector<Path> &shard_files, const std::vector<std::string> &reflection_markers)
+{
+    file_extracts.clear();
+    listed_files.clear();
+    indexed_classes.clear();
+    classes_on_demand = false;
+
+    for(const Path &shard : shard_files)
+    {
+        mapped_file mapped(shard);
+        record_reader in(mapped.data(), mapped.size());
+        if(!mapped.is_open() || !in.read_header(shard_magic, shard_format_version) || in.read_string() != gluegen_version)
+        {
+            std::cerr << "Could not read the shard file (or it got written by another gluegen version): " << shard << std::endl;
+            return false;
+        }
+        // the extracts only contain what got marked with the markers of that run, merging them would silently miss variables.
+        if(in.read_strings() != reflection_markers)
+        {
+            std::cerr << "ERROR: the shard file " << shard << " got extracted with other reflection markers" << std::endl;
+            return false;
+        }
+
+        for(uint32_t i = 0, count = in.read_u32(); in.ok && i < count; i++)
+        {
+            const string name = in.read_string();
+            AST_file_extract extract;
+            if(!read_extract(in, extract)) break;
+            auto existing = file_extracts.find(name);
+            if(existing != file_extracts.end()) merge_shard_extract(existing->second, std::move(extract));
+            else
+            {
+                file_extracts.emplace(name, std::move(extract));
+                listed_files.push_back(name);
+            }
+        }
+        if(!in.done())
+        {
+            std::cerr << "Corrupt shard file: " << shard << std::endl;
+            return false;
+        }
     }
+    // the same order load_from_directory would have loaded them in, if they all were in one folder.
+    std::sort(listed_files.begin(), listed_files.end());
+    merge_file_extracts();
     return true;
 }
 
+void ASTs::merge_file_extracts()
+{
+    attribute_definitions.clear();
+    class_compounds.clear();
+    shared_var_occurences.clear();
+
+    // in listing order, so we end up with the same result as when loading them on a single thread.
+    for(const Path &file : listed_files)
+    {
+        auto extract = file_extracts.find(file.string());
+        if(extract == file_extracts.end()) continue;
+        if(keep_file_extracts) add_extract(AST_file_extract(extract->second));
+        else add_extract(std::move(extract->second));
+    }
+    if(!keep_file_extracts) file_extracts.clear();
+}
+
+void ASTs::add_extract(AST_file_extract &&extract)
+{
+    switch(extract.kind)
+    {
+        case AST_file_extract::NOTHING:
+            break;
+        case AST_file_extract::CODE:
+            for(SharedVariable &var : extract.shared_vars)
+                shared_var_occurences.push_back(std::move(var));
+            break;
+        case AST_file_extract::CLASS:
+        {
+            const string refid = extract.compound.refid;
+            class_compounds[refid] = std::move(extract.compound);
+            break;
+        }
+        case AST_file_extract::ATTRIBUTE_CLASS:
+        {
+            const string name = extract.attribute.name;
+            attribute_definitions[name] = std::move(extract.attribute);
+            break;
+        }
+    }
+}
+
 
 } } // ns inexor::gluegen
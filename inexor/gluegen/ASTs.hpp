@@ -4,10 +4,14 @@
 #include <pugixml.hpp>
 
 #include "inexor/filesystem/path.hpp"
+#include "inexor/gluegen/SharedVariables.hpp"
+#include "inexor/gluegen/SharedVarDatatypes.hpp"
+#include "inexor/gluegen/SharedAttributes.hpp"
 
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <memory>
 
 namespace inexor {
 namespace gluegen {
@@ -29,7 +33,31 @@ namespace gluegen {
 //                 declname <-
 //                 defval
 
-/// Class containing all xml files (and filenames)
+/// Everything we extract from a single doxygen AST xml file.
+///
+/// Later stages do not need anything else from the file, so this is what the extraction cache stores.
+struct AST_file_extract
+{
+    enum kind_t
+    {
+        NOTHING,
+        CODE,           ///< The AST of a source file, containing shared_vars.
+        CLASS,          ///< The AST of a class definition, see compound.
+        ATTRIBUTE_CLASS ///< The AST of a SharedAttribute class definition, see attribute.
+    };
+    kind_t kind = NOTHING;
+
+    /// The marked variables found in a code AST.
+    std::vector<SharedVariable> shared_vars;
+
+    /// The class definition of a class AST.
+    class_compound compound;
+
+    /// The attribute definition of an attribute class AST.
+    attribute_definition attribute;
+};
+
+/// Class containing everything we extracted from the doxygen xml files.
 ///
 /// The .xml files contain doxygen generated ASTs (Abstract Syntax Trees)
 /// Doxygen knows two types of such xml files: xml-files for source files, xml-files for class definitions.
@@ -40,20 +68,106 @@ struct ASTs
 
 
     /// In case the class xml is a shared option definition, it will be saved in here.
-    std::vector<xml_document_ptr> attribute_class_xmls;
+    /// Key is the name of the attribute.
+    std::unordered_map<std::string, attribute_definition> attribute_definitions;
 
     /// In case the class xml is not a shared option definition, it will be saved in here.
     /// Key is the ID of the class.
-    std::unordered_map<std::string, xml_document_ptr> class_xmls;
+    std::unordered_map<std::string, class_compound> class_compounds;
+
+    /// The marked variables found in the ASTs of all source code files.
+    std::vector<SharedVariable> shared_var_occurences;
+
+    /// Loads the xml files (below the directory, recursively) and extracts their contents to attribute_definitions, class_compounds or shared_var_occurences.
+    /// @param jobs the number of threads parsing the files concurrently (0 = one per hardware thread).
+    /// @param reflection_markers if given, code ASTs not containing any of these strings do not get parsed (and are left out).
+    /// @param cache_directory if given, the extracts of the files get stored there and unchanged files are not parsed again.
+    void load_from_directory(const Path &directory, size_t jobs = 1,
+                             const std::vector<std::string> &reflection_markers = std::vector<std::string>(),
+                             const Path &cache_directory = Path());
+
+    /// Loads the ASTs listed in doxygens index.xml of the directory instead of guessing what a file contains by its name.
+    /// Only the code ASTs and the classes possibly deriving from SharedOption get loaded right away, all other
+    /// classes only when load_class_compounds asks for them.
+    /// Parameters are the same as for load_from_directory.
+    /// @return false if the directory contains no (readable) index.xml, or xml files in subdirectories (not covered by it).
+    bool load_from_index(const Path &directory, size_t jobs = 1,
+                         const std::vector<std::string> &reflection_markers = std::vector<std::string>(),
+                         const Path &cache_directory = Path());
+
+    /// Whether load_from_index got used, so class_compounds only contains the classes loaded so far.
+    bool loads_classes_on_demand() const { return classes_on_demand; }
+
+    /// Loads the class ASTs with the given refids into class_compounds, after load_from_index.
+    /// Refids not listed in the index or loaded already get ignored.
+    /// @param jobs the number of threads parsing the files concurrently (0 = one per hardware thread).
+    void load_class_compounds(const std::vector<std::string> &refids, size_t jobs = 1);
 
-    /// The xml files containing the ASTs of all source code files.
-    std::vector<xml_document_ptr> code_xmls;
+    /// Whether file_extracts are kept after merging them, which update_from_directory requires.
+    bool keep_file_extracts = false;
 
-    /// Loads the xml files into memory and sorts them to class, code or option_xmls.
-    void load_from_directory(const Path &directory);
+    /// Loads only the changed xml files again (added, modified or removed ones), after load_from_directory.
+    /// The extracts of all other files are reused, the members above get rebuilt from them.
+    /// @note requires keep_file_extracts.
+    void update_from_directory(const Path &directory, const std::vector<Path> &changed_files, size_t jobs = 1,
+                               const std::vector<std::string> &reflection_markers = std::vector<std::string>(),
+                               const Path &cache_directory = Path());
+
+    /// Scans the C++ headers and sources below the directory directly instead of loading doxygens AST of them.
+    /// See scan_source for what the scanner understands. The result is the same as load_from_directory gives
+    /// for the doxygen AST of these files, except the definition_header of the classes is relative to the directory.
+    /// @param reflection_markers if given, source files (not headers) not containing any of these strings are skipped.
+    void load_from_sources(const Path &directory, size_t jobs = 1,
+                           const std::vector<std::string> &reflection_markers = std::vector<std::string>());
+
+    /// Writes what got extracted from each xml file to a shard file, after load_from_directory (or load_from_shards).
+    /// Several processes can extract parts of the ASTs this way, load_from_shards merges them afterwards.
+    /// @note requires keep_file_extracts.
+    /// @return false if the file could not be written.
+    bool write_shard(const Path &file, const std::vector<std::string> &reflection_markers) const;
+
+    /// Loads the extracts of several shard files (of the same gluegen version), as if all their xml files were in one
+    /// folder passed to load_from_directory. The marked variables of code ASTs with the same name in several shards
+    /// (e.g. each module's namespaceinexor.xml) get united, of class ASTs with the same name the first one is used.
+    /// @return false if a shard file could not be read or got extracted with other reflection markers.
+    bool load_from_shards(const std::vector<Path> &shard_files, const std::vector<std::string> &reflection_markers);
 
 private:
-    bool load_xml_file(const Path &file, xml_document_ptr &xml);
+    /// What got extracted from each xml file, by its path.
+    std::unordered_map<std::string, AST_file_extract> file_extracts;
+
+    /// The xml files in listing order, the extracts get merged in this order.
+    std::vector<Path> listed_files;
+
+    /// The class ASTs listed in the index.xml which did not get loaded yet by their refid, see load_from_index.
+    std::unordered_map<std::string, Path> indexed_classes;
+    bool classes_on_demand = false;
+
+    /// The reflection markers and cache directory passed to load_from_index, for loading the classes later on.
+    std::vector<std::string> index_reflection_markers;
+    Path index_cache_directory;
+
+    /// What a file is known to contain before loading it.
+    enum file_role
+    {
+        ROLE_BY_NAME,     ///< Unknown, guess it by its file name.
+        ROLE_CODE,
+        ROLE_CLASS,
+        ROLE_OPTION_CLASS ///< A class, which only gets loaded if it could derive from SharedOption.
+    };
+
+    /// Loads the files into file_extracts.
+    /// @param roles the role of each file, if empty every file gets guessed by its name.
+    void load_files(const std::vector<Path> &files, const std::vector<file_role> &roles, size_t jobs,
+                    const std::vector<std::string> &reflection_markers, const Path &cache_directory);
+
+    /// Rebuilds attribute_definitions, class_compounds and shared_var_occurences from file_extracts.
+    void merge_file_extracts();
+
+    bool parse_xml_buffer(inexor::filesystem::mapped_file &buffer, xml_document_ptr &xml);
+
+    /// Sorts the extract of one file into our members.
+    void add_extract(AST_file_extract &&extract);
 };
 
 } } // ns inexor::gluegen
@@ -10,6 +10,7 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <algorithm>
 
 using namespace std;
 using namespace pugi;
@@ -24,29 +25,21 @@ namespace inexor { namespace gluegen {
 /// We furthermore require to have default values for either all or no constructor arguments.
 /// + all default_values across all constructors need to be the same.
 /// Error if those requirements aren't met.
-function_parameter parse_constructors_arg(const xml_node &arg_xml)
+function_parameter parse_constructors_arg(const function_parameter &raw_arg)
 {
         function_parameter arg;
-        arg.name = get_complete_xml_text(arg_xml.child("declname"));
-        arg.type = get_complete_xml_text(arg_xml.child("type"));
+        arg.name = raw_arg.name;
+        arg.type = raw_arg.type;
 
-        string raw_default_value = get_complete_xml_text(arg_xml.child("defval"));
+        const string &raw_default_value = raw_arg.default_value;
         if(!raw_default_value.empty())
         {
             std::string dummy;
 
             // remove possible cast operations
             // i.e. fu_cast<float>( "{{index}}\n{{name}}" ) -> ' "{{index}}\n{{name}}" '
-            arg.default_value = parse_bracket(raw_default_value, dummy, dummy);
-
-            // remove whitespace around the argument
-            trim(arg.default_value);
-
-            // -> {{index}}'\''n'{{name}}
-            remove_surrounding_quotes(arg.default_value);
-
-            // replace "\\n" with newline char.
-            unescape(arg.default_value);
+            // -> {{index}}<newline>{{name}} (trimmed, without quotes and with the escape sequences replaced)
+            arg.default_value = normalize_literal(parse_bracket(raw_default_value, dummy, dummy));
         }
         std::cout << "Constructor Argument Name: " << arg.name
                    << (arg.default_value.empty() ? "" : " (default: "+arg.default_value+", raw: "+raw_default_value+")")
@@ -55,14 +48,12 @@ function_parameter parse_constructors_arg(const xml_node &arg_xml)
         return arg;
 }
 
-const attribute_definition::constructor parse_constructor(const xml_node &constructor_xml)
+const attribute_definition::constructor parse_constructor(const std::vector<function_parameter> &raw_args)
 {
     attribute_definition::constructor constr;
 
-    std::vector<function_parameter> constructor_args;
-
-    for(const xml_node &param : constructor_xml.children("param")) {
-        constr.constructor_args.push_back(parse_constructors_arg(param));
+    for(const function_parameter &raw_arg : raw_args) {
+        constr.constructor_args.push_back(parse_constructors_arg(raw_arg));
     }
 
     // last arg must have a default value..
@@ -72,6 +63,18 @@ const attribute_definition::constructor parse_constructor(const xml_node &constr
     return constr;
 }
 
+const attribute_definition new_shared_attribute_definition(const std::string &class_name,
+                                                           const std::vector<std::vector<function_parameter>> &raw_constructors)
+{
+    attribute_definition opt{string(class_name)};
+    std::cout << "Attribute class found: " << opt.name << std::endl;
+
+    for (const auto &raw_args : raw_constructors)
+        opt.constructors.push_back(parse_constructor(raw_args));
+
+    return opt;
+}
+
 /// This function parses an attribute_definition xml node and save it to our attribute_definitions map.
 ///
 /// We require to have all constructor arguments named the same.
@@ -81,25 +84,32 @@ const attribute_definition::constructor parse_constructor(const xml_node &constr
 // TODO: Error if those requirements aren't met.
 const attribute_definition parse_shared_attribute_definition(const xml_node &compound_xml)
 {
-    attribute_definition opt(get_complete_xml_text(compound_xml.child("compoundname")));
-    std::cout << "Attribute class found: " << opt.name << std::endl;
-
+    std::vector<std::vector<function_parameter>> raw_constructors;
     for (const auto &constructor_xml : find_class_constructors(compound_xml))
-        opt.constructors.push_back(parse_constructor(constructor_xml));
-
-    return opt;
+    {
+        raw_constructors.emplace_back();
+        for(const xml_node &param : constructor_xml.children("param"))
+        {
+            function_parameter raw_arg;
+            raw_arg.name = get_complete_xml_text(param.child("declname"));
+            raw_arg.type = get_complete_xml_text(param.child("type"));
+            raw_arg.default_value = get_complete_xml_text(param.child("defval"));
+            raw_constructors.back().push_back(raw_arg);
+        }
+    }
+    return new_shared_attribute_definition(get_complete_xml_text(compound_xml.child("compoundname")), raw_constructors);
 }
 
-const unordered_map<string, attribute_definition>
-    parse_shared_attribute_definitions(const vector<unique_ptr<xml_document>> &AST_xmls)
+vector<const attribute_definition *> sorted_attribute_definitions(const unordered_map<string, attribute_definition> &attribute_definitions)
 {
-    unordered_map<string, attribute_definition> attribute_definitions;
-    for(const auto &ast : AST_xmls) {
-        xml_node compound_ast = ast->child("doxygen").child("compounddef");
-        auto opt = parse_shared_attribute_definition(compound_ast);
-        attribute_definitions[opt.name] = opt;
-    }
-    return attribute_definitions;
+    vector<const attribute_definition *> sorted;
+    sorted.reserve(attribute_definitions.size());
+    for(const auto &deftupel : attribute_definitions)
+        sorted.push_back(&deftupel.second);
+    std::sort(sorted.begin(), sorted.end(), [](const attribute_definition *a, const attribute_definition *b) {
+        return a->name < b->name;
+    });
+    return sorted;
 }
 
 } } // namespace inexor::gluegen
@@ -52,10 +52,18 @@ struct attribute_definition
     attribute_definition() {}
     attribute_definition(std::string &&class_name) : name(class_name) {}
 };
-/// Parses all shared attribute ASTs and return the resulting shared_attributes map.
-/// Key of the resulting map: name of attribute
-extern const std::unordered_map<std::string, attribute_definition>
-    parse_shared_attribute_definitions(const std::vector<std::unique_ptr<pugi::xml_document>> &AST_xmls);
+/// Parses the compounddef node of a shared attribute class AST.
+extern const attribute_definition parse_shared_attribute_definition(const pugi::xml_node &compound_xml);
+
+/// Creates an attribute definition from the constructors of the class as declared in the source.
+/// The default values are taken raw (e.g. "fu_cast<float>(\"{{index}}\")"), they get normalized here.
+extern const attribute_definition new_shared_attribute_definition(const std::string &class_name,
+                                                                  const std::vector<std::vector<function_parameter>> &raw_constructors);
+
+/// The attribute definitions sorted by name.
+/// Use this instead of iterating the map whenever the order ends up in a file, so it does not change between runs.
+extern std::vector<const attribute_definition *> sorted_attribute_definitions(
+        const std::unordered_map<std::string, attribute_definition> &attribute_definitions);
 
 }
 }
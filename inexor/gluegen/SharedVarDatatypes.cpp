@@ -1,13 +1,17 @@
 #include "inexor/gluegen/SharedVarDatatypes.hpp"
 #include "inexor/gluegen/SharedVariables.hpp"
 #include "inexor/gluegen/parse_helpers.hpp"
+#include "inexor/gluegen/stage_timings.hpp"
+#include "inexor/gluegen/parallel.hpp"
 
 #include <kainjow/mustache.hpp>
 
 #include <boost/algorithm/string.hpp>
 
+#include <memory>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <set>
 
@@ -30,133 +34,313 @@ std::pair <const vector<string>, const string> split_into_namspace_and_name(cons
 };
 
 /// Return the header file a given class was defined in.
-/// If the class was not defined in a header, issues an error and quits the program.
-const string get_definitions_header_file(const xml_node &compound_xml, const string &classname)
+/// If the class was not defined in a header, throws a shared_class_error.
+const string get_definitions_header_file(const class_compound &compound)
 {
-    const string definition_header = compound_xml.child("location").attribute("file").value();
-
-    if(contains(definition_header, ".c"))
-    {
-        std::cerr << "ERROR: SharedClasses can only be defined in cleanly include-able **header**-files\n"
-                  << "Class in question is " << classname << std::endl;
-        std::exit(1);
-    }
-    return definition_header;
+    if(contains(compound.definition_header, ".c"))
+        throw shared_class_error("SharedClasses can only be defined in cleanly include-able **header**-files\n"
+                                 "Class in question is " + compound.full_name);
+    return compound.definition_header;
 }
 
-shared_class_definition new_shared_class_definition(const xml_node &compound_xml)
+shared_class_definition new_shared_class_definition(const class_compound &compound)
 {
     shared_class_definition def;
 
-    def.refid = compound_xml.attribute("id").value();
-    string full_name =  get_complete_xml_text(compound_xml.child("compoundname"));
-    const auto &name_ns_tuple = split_into_namspace_and_name(full_name);
+    def.refid = compound.refid;
+    const auto &name_ns_tuple = split_into_namspace_and_name(compound.full_name);
     def.definition_namespace = name_ns_tuple.first;
     def.class_name = name_ns_tuple.second;
-    def.definition_header = get_definitions_header_file(compound_xml, full_name);
+    def.definition_header = get_definitions_header_file(compound);
 
     return def;
 }
 
+/// Returns the name of a template parameter or an empty string if we do not recognize it.
+string parse_template_param_name(const xml_node &template_param)
+{
+    std::string param_str = template_param.child("defname").child_value();
+
+    if (param_str.empty()) {
+        // Sometimes doxygen does not recognize the defname correctly, so we split the type "typename/class T"
+        // manually.
+        const string param_str_lit = template_param.child("type").child_value();
+        const std::vector<string> param_words(split_by_delimiter(param_str_lit, " ")); // e.g. "typename", "U"
+        param_str = param_words.size() == 2 ? param_words[1] : "";
+    }
+    return param_str;
+}
+
+class_compound parse_class_compound(const xml_node &compound_xml)
+{
+    class_compound compound;
+
+    compound.refid = compound_xml.attribute("id").value();
+    compound.full_name = get_complete_xml_text(compound_xml.child("compoundname"));
+    compound.definition_header = compound_xml.child("location").attribute("file").value();
+
+    for(const auto &template_param : compound_xml.child("templateparamlist").children())
+        compound.template_params.push_back(parse_template_param_name(template_param));
+
+    // Check all elements of the class definition for markers
+    const vector<string> definition_namespace = split_into_namspace_and_name(compound.full_name).first;
+    for(const xml_node &var_xml : find_class_member_vars(compound_xml))
+    {
+        string initializer;
+        size_t marker_pos;
+        if(find_reflection_marker(var_xml, initializer, marker_pos))
+            compound.marked_members.emplace_back(var_xml, definition_namespace, initializer, marker_pos);
+    }
+    return compound;
+}
+
+type_id type_table::intern(const SharedVariable::type_node_t &type)
+{
+    std::vector<type_id> template_types;
+    template_types.reserve(type.template_types.size());
+    for(const auto &t : type.template_types)
+        template_types.push_back(intern(t));
+
+    string key = type.refid;
+    key += '\0';
+    key += type.pure_type;
+    key += '\0';
+    key.append(reinterpret_cast<const char *>(template_types.data()), template_types.size() * sizeof(type_id));
+
+    const auto exact_it = exact_index.find(key);
+    if(exact_it != exact_index.end())
+        return exact_it->second;
+
+    const type_id id = static_cast<type_id>(entries.size());
+    entry e;
+    e.refid = type.refid;
+    e.pure_type = type.pure_type;
+    e.unique_id = type.refid;
+    for(size_t i = 0; i < template_types.size(); i++)
+    {
+        e.unique_id += i == 0 ? "<" : ",";
+        e.unique_id += entries[template_types[i]].unique_id;
+    }
+    if(!template_types.empty()) e.unique_id += ">";
+    e.template_types = std::move(template_types);
+    e.canonical = canonical_index.emplace(e.unique_id, id).first->second;
+
+    entries.push_back(std::move(e));
+    exact_index.emplace(std::move(key), id);
+    return id;
+}
+
+SharedVariable::type_node_t type_table::node(type_id id) const
+{
+    SharedVariable::type_node_t type;
+    type.refid = entries[id].refid;
+    type.pure_type = entries[id].pure_type;
+    for(const type_id template_type : entries[id].template_types)
+        type.template_types.push_back(node(template_type));
+    return type;
+}
+
+void type_table::add_definition(type_id id, shared_class_definition &&def)
+{
+    entries[entries[id].canonical].definition = class_definitions.size();
+    class_definitions.push_back(std::move(def));
+}
 
 /// If a set of template parameters were given for a class and a set of corresponding types were given for
 /// an instance of such a class, the result will be a map, mapping the alias to the real type of the instance.
 ///
 /// This map will be used when constructing any member variables where the type is an alias.
-void add_template_type_alias(const xml_node &compound_xml, const SharedVariable::type_node_t *const type,
+void add_template_type_alias(const class_compound &compound, const SharedVariable::type_node_t *const type,
                              unordered_map<string, const SharedVariable::type_node_t *> &map)
 {
-    if (!compound_xml.child("templateparamlist"))
-        return;
-    size_t i = 0;
-    for(const auto &template_param : compound_xml.child("templateparamlist").children())
+    for(size_t i = 0; i < compound.template_params.size(); i++)
     {
-        std::string param_str = template_param.child("defname").child_value();
-
-        if (param_str.empty()) {
-            // Sometimes doxygen does not recognize the defname correctly, so we split the type "typename/class T"
-            // manually.
-            const string param_str_lit = template_param.child("type").child_value();
-            const std::vector<string> param_words(split_by_delimiter(param_str_lit, " ")); // e.g. "typename", "U"
-            param_str = param_words.size() == 2 ? param_words[1] : "";
-        }
-
+        const string &param_str = compound.template_params[i];
         if (param_str.empty())
-        {
-            std::cerr << "ERROR: Template parameters of types of variables marked for reflection not recognized for \n"
-                      << "type " << compound_xml.child("compoundname").child_value() << std::endl;
-            std::exit(1);
-        }
+            throw shared_class_error("Template parameters of types of variables marked for reflection not recognized for \n"
+                                     "type " + compound.full_name);
 
         if (type->template_types.size() <= i)
+            throw shared_class_error("Template parameters of SharedClass definition does not match instance\n"
+                                     "Class in question is " + compound.full_name);
+        map.emplace(param_str, &type->template_types[i]);
+    }
+}
+
+/// A type instantiation find_class_definitions creates a shared class definition for.
+struct class_resolution
+{
+    type_id type;
+
+    /// The type as first found, its template types get used when resolving template aliases.
+    const SharedVariable::type_node_t *type_node;
+    const class_compound *compound;
+
+    shared_class_definition class_def;
+
+    /// The interned types of the elements of the definition.
+    std::vector<type_id> element_types;
+
+    /// Why the class could not be resolved, see shared_class_error.
+    std::string error;
+
+    class_resolution(type_id type, const SharedVariable::type_node_t *type_node, const class_compound *compound)
+        : type(type), type_node(type_node), compound(compound) {}
+
+    bool added = false;
+};
+
+/// Creates the definition for the type, independent of any other resolution.
+void resolve_class(class_resolution &resolution, const std::string &trace_name)
+{
+    stage_timings::detail_scope trace("resolve_class", trace_name);
+    const class_compound &compound = *resolution.compound;
+
+    shared_class_definition &class_def = resolution.class_def;
+    class_def = new_shared_class_definition(compound);
+
+    // get all template parameters for this class and see what the instance maps them to.
+    unordered_map<string, const SharedVariable::type_node_t *>  type_resolve_map;
+    add_template_type_alias(compound, resolution.type_node, type_resolve_map);
+
+    // Supported template use cases:
+    // 1. class/typename can be used
+    // 1b. templated class in templated class has templated member.
+
+    // TODO: Default parameters for templates
+    // TODO: non-type template parameters
+    // template<int X = 100> can be used (value as default value)
+    // template<class X = int> can be used (type as default value)
+    // template<class Type1, class Type2 = Type1> can be used (type is other type)
+    // empty <> instantion possible when using default values
+    /// Spezialisierungen
+
+
+    for(const SharedVariable &member : compound.marked_members)
+    {
+        SharedVariable element(member);
+        // if type was not fully resolved, because there was a template alias used,
+        // we resolve it.
+        if(type_resolve_map.count(element.type.refid) != 0)
         {
-            std::cerr << "ERROR: Template parameters of SharedClass definition does not match instance\n"
-                      << "Class in question is " << compound_xml.child("compoundname").child_value() << std::endl;
-            std::exit(1);
+            // the type element always ones the type ptr, therefore create a new one.
+            element.type = *type_resolve_map[element.type.refid];
         }
-        map.emplace(param_str, &type->template_types[i]);
-        i++;
+
+        class_def.elements.push_back(std::move(element));
     }
 }
 
-void find_class_definitions(const unordered_map<string, unique_ptr<xml_document>> &AST_class_xmls,
+/// Adds the definitions of the type and (first) of the types of its elements, in the order a depth first search
+/// starting at the variables would add them.
+void add_resolved_definitions(type_id type, type_table &types, const unordered_map<type_id, size_t> &resolution_index,
+                              std::vector<std::unique_ptr<class_resolution>> &resolutions)
+{
+    if(types.find_definition(type))
+        // already a known type
+        return;
+    const auto it = resolution_index.find(type);
+    if(it == resolution_index.end()) return;
+    class_resolution &resolution = *resolutions[it->second];
+    if(resolution.added) return;
+    resolution.added = true;
+
+    for(const type_id element_type : resolution.element_types)
+        add_resolved_definitions(element_type, types, resolution_index, resolutions);
+    resolution.class_def.type = resolution.type;
+    types.add_definition(resolution.type, std::move(resolution.class_def));
+}
+
+void find_class_definitions(const unordered_map<string, class_compound> &class_compounds,
                             const std::vector<SharedVariable> &shared_vars,
-                            unordered_map<string, shared_class_definition> &class_definitions)
+                            type_table &types, size_t jobs, const class_compound_loader &load_compounds)
 {
-    for(const auto &var : shared_vars)
+    // The classes get resolved level by level: each distinct type instantiation of a level gets resolved in parallel,
+    // the types of their members form the next level.
+    // The type table is not thread safe, so the types get interned (and deduplicated) between the levels.
+    std::vector<std::unique_ptr<class_resolution>> resolutions;
+    unordered_map<type_id, size_t> resolution_index;
+    std::vector<size_t> level, next_level;
+
+    auto enqueue = [&](const SharedVariable::type_node_t &type_node) -> type_id
     {
-        string var_type_hash = var.type.uniqueID();
-        if(class_definitions.count(var_type_hash) != 0)
-            // already a known type
-            continue;
-
-        if(AST_class_xmls.find(var.type.refid) == AST_class_xmls.end()) {
-        //    std::cerr << "ERROR: variable '" << var.name << "'has been marked for reflection, but type is not known.\n"
-        //              << "type in question is " << var_type_hash << std::endl;
-            continue;
-        }
-        const xml_node &compound_xml = AST_class_xmls.at(var.type.refid)->child("doxygen").child("compounddef");
+        const type_id type = types.intern(type_node);
+        if(types.find_definition(type) || resolution_index.count(type)) return type;
 
-        shared_class_definition class_def = new_shared_class_definition(compound_xml);
+        const auto compound_it = class_compounds.find(type_node.refid);
+        if(compound_it == class_compounds.end()) {
+        //    std::cerr << "ERROR: variable has been marked for reflection, but type is not known.\n"
+        //              << "type in question is " << types[type].unique_id << std::endl;
+            return type;
+        }
+        resolution_index.emplace(type, resolutions.size());
+        next_level.push_back(resolutions.size());
+        resolutions.emplace_back(new class_resolution(type, &type_node, &compound_it->second));
+        return type;
+    };
 
-        class_def.type_node = var.type;
+    // the classes of a level get requested all at once, so the loader can load them in parallel.
+    unordered_set<string> requested_refids;
+    auto request_compounds = [&](const std::vector<const SharedVariable::type_node_t *> &type_nodes)
+    {
+        if(!load_compounds) return;
+        std::vector<string> refids;
+        for(const SharedVariable::type_node_t *type_node : type_nodes)
+            if(!class_compounds.count(type_node->refid) && requested_refids.insert(type_node->refid).second)
+                refids.push_back(type_node->refid);
+        if(!refids.empty()) load_compounds(refids);
+    };
 
-        // get all template parameters for this class and see what the instance maps them to.
-        unordered_map<string, const SharedVariable::type_node_t *>  type_resolve_map;
-        add_template_type_alias(compound_xml, &var.type, type_resolve_map);
+    std::vector<const SharedVariable::type_node_t *> level_type_nodes;
+    for(const auto &var : shared_vars)
+        level_type_nodes.push_back(&var.type);
+    request_compounds(level_type_nodes);
 
-        // Supported template use cases:
-        // 1. class/typename can be used
-        // 1b. templated class in templated class has templated member.
+    std::vector<type_id> var_types;
+    for(const auto &var : shared_vars)
+        var_types.push_back(enqueue(var.type));
 
-        // TODO: Default parameters for templates
-        // TODO: non-type template parameters
-        // template<int X = 100> can be used (value as default value)
-        // template<class X = int> can be used (type as default value)
-        // template<class Type1, class Type2 = Type1> can be used (type is other type)
-        // empty <> instantion possible when using default values
-        /// Spezialisierungen
+    while(!next_level.empty())
+    {
+        level.swap(next_level);
+        next_level.clear();
 
+        std::vector<std::string> trace_names(level.size());
+        if(stage_timings::tracing)
+            for(size_t i = 0; i < level.size(); i++)
+                trace_names[i] = types[resolutions[level[i]]->type].unique_id;
 
-        // Check all elements of the class definition for markers
-        for(const xml_node &var_xml : find_class_member_vars(compound_xml))
-        {
-            if(not is_marked_variable(var_xml))
-                continue;
-            SharedVariable element(var_xml, class_def.definition_namespace);
-            // if type was not fully resolved, because there was a template alias used,
-            // we resolve it.
-            if(type_resolve_map.count(element.type.refid) != 0)
-            {
-                // the type element always ones the type ptr, therefore create a new one.
-                element.type = *type_resolve_map[element.type.refid];
+        // the errors get reported by the calling thread, in the same order for any number of jobs.
+        parallel_for(level.size(), jobs, [&](size_t i) {
+            class_resolution &resolution = *resolutions[level[i]];
+            try {
+                resolve_class(resolution, trace_names[i]);
             }
+            catch(const shared_class_error &e) {
+                resolution.error = e.what();
+            }
+        });
+        string errors;
+        for(const size_t index : level)
+            if(!resolutions[index]->error.empty()) errors += "ERROR: " + resolutions[index]->error + "\n";
+        if(!errors.empty()) throw shared_class_error(errors);
+
+        level_type_nodes.clear();
+        for(const size_t index : level)
+            for(const SharedVariable &element : resolutions[index]->class_def.elements)
+                level_type_nodes.push_back(&element.type);
+        request_compounds(level_type_nodes);
 
-            class_def.elements.push_back(std::move(element));
+        for(const size_t index : level)
+        {
+            class_resolution &resolution = *resolutions[index];
+            for(const SharedVariable &element : resolution.class_def.elements)
+                resolution.element_types.push_back(enqueue(element.type));
         }
-        find_class_definitions(AST_class_xmls, class_def.elements, class_definitions);
-        class_definitions.insert({var_type_hash, std::move(class_def)});
     }
+
+    for(const type_id var_type : var_types)
+        add_resolved_definitions(var_type, types, resolution_index, resolutions);
 }
 
 } } // namespace inexor::gluegen
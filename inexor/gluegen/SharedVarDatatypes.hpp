@@ -4,18 +4,23 @@
 
 #include <kainjow/mustache.hpp>
 
+#include <cstdint>
 #include <vector>
 #include <unordered_map>
 #include <string>
+#include <functional>
+#include <stdexcept>
 
 namespace inexor { namespace gluegen {
 
+/// The dense index of a type in a type_table.
+typedef uint32_t type_id;
 
 struct shared_class_definition
 {
-    /// This includes the template argument information.
-    /// E.g. type_node.print() would give you "Screen<int, int>".
-    SharedVariable::type_node_t type_node;
+    /// The interned type, this includes the template argument information.
+    /// E.g. printing it would give you "Screen<int, int>".
+    type_id type;
 
     /// The name of the SharedClass e.g. "Screen".
     std::string class_name;
@@ -37,14 +42,126 @@ struct shared_class_definition
     std::vector<SharedVariable> elements;
 };
 
+/// Interned (hash-consed) type trees: every distinct type_node_t gets a dense type_id, identical types share one entry.
+///
+/// Each entry caches its unique ID and the shared class definition of the type (if any), so lookups are array indexing
+/// instead of rebuilding and hashing the printed type.
+class type_table
+{
+  public:
+    static const size_t no_definition = size_t(-1);
+
+    struct entry
+    {
+        /// Either the refid of the class or empty.
+        std::string refid;
+
+        /// The pure type literal, as written when the type got interned first.
+        std::string pure_type;
+
+        std::vector<type_id> template_types;
+
+        /// The refid with the unique IDs of the template types, e.g. "class_screen<,>".
+        /// @note builtin types have no refid, so "Screen<int>" and "Screen<float>" share the unique ID.
+        std::string unique_id;
+
+        /// The first interned type with the same unique ID, class definitions get attached to that one.
+        type_id canonical;
+
+        /// Index into definitions() or no_definition, only set on canonical entries.
+        size_t definition = no_definition;
+
+        /// The printed names of print_data, empty until first needed.
+        std::string type_name_cpp, type_name_unique;
+    };
+
+    /// Returns the ID of the type, adding it (and its template types) if it is new.
+    type_id intern(const SharedVariable::type_node_t &type);
+
+    /// Builds the type tree of an interned type again (without parent links).
+    SharedVariable::type_node_t node(type_id id) const;
+
+    const entry &operator[](type_id id) const { return entries[id]; }
+    entry &operator[](type_id id) { return entries[id]; }
+
+    /// The shared class definition of a type or nullptr if there is none (yet).
+    const shared_class_definition *find_definition(type_id id) const
+    {
+        const size_t index = entries[entries[id].canonical].definition;
+        return index == no_definition ? nullptr : &class_definitions[index];
+    }
+
+    /// Attaches the definition to the type (and all others with the same unique ID).
+    void add_definition(type_id id, shared_class_definition &&def);
+
+    /// All definitions in the order they were added.
+    const std::vector<shared_class_definition> &definitions() const { return class_definitions; }
+
+    size_t size() const { return entries.size(); }
+
+  private:
+    std::vector<entry> entries;
+    std::vector<shared_class_definition> class_definitions;
+
+    /// Key is the refid, the pure type and the IDs of the template types.
+    std::unordered_map<std::string, type_id> exact_index;
+
+    /// Key is the unique ID.
+    std::unordered_map<std::string, type_id> canonical_index;
+};
+
+/// Everything we need to know about a class AST, independent of any instance of that class.
+///
+/// This is the part of the class AST we extract once per file, shared_class_definitions get created from it
+/// for every instance type (e.g. for Screen<int> and Screen<float>).
+struct class_compound
+{
+    /// The reference identification number used by doxygen.
+    std::string refid;
+
+    /// The complete name including the namespace, e.g. "inexor::metainfo::Screen".
+    std::string full_name;
+
+    /// The file the class was defined in.
+    /// @note we do not check whether this is a header here, only when an instance of this class gets used.
+    std::string definition_header;
+
+    /// The names of the template parameters in order, e.g. "T" for template<typename T>.
+    /// A name is empty if doxygen did not provide it in a form we recognize.
+    std::vector<std::string> template_params;
+
+    /// All members marked for reflection, in their namespace.
+    /// Their types are not resolved yet, so they may still refer to a template parameter.
+    std::vector<SharedVariable> marked_members;
+};
+
+/// A class of a marked variable which can not be used as shared class, e.g. since it is not defined in a header.
+struct shared_class_error : public std::runtime_error
+{
+    explicit shared_class_error(const std::string &message) : std::runtime_error(message) {}
+};
+
+/// Adds the class compounds with the given refids to the class_compounds passed to find_class_definitions.
+/// Unknown refids (e.g. of builtin types) get ignored.
+typedef std::function<void(const std::vector<std::string> &refids)> class_compound_loader;
+
+/// Extracts the instance independent information from the compounddef node of a class AST.
+extern class_compound parse_class_compound(const pugi::xml_node &compound_xml);
+
 /// Return a number of parsed shared class definitions, given a list of sharedvars, which types we want to have obtained.
 /// Note: if a classes member is marked, its type will also be appended to the return vector.
-/// @param AST_class_xmls the AST as parsed by doxygen in XML files. Each file corresponds to the definition of a class.
-///                       the key is the ID of the class (i.e. the type ID).
+/// @param class_compounds the classes as extracted from the doxygen class ASTs. Each corresponds to the definition of a class.
+///                        the key is the ID of the class (i.e. the type ID).
 /// @param shared_vars for each of those, the t of type IDs (as found in the AST) which are relevant.
-/// @param class_definitions the map to be filled, key is always the printed out type.
-extern void find_class_definitions(const std::unordered_map<std::string, std::unique_ptr<pugi::xml_document>> &AST_class_xmls,
+/// @param types the table the found definitions get added to.
+/// @param jobs the distinct types of each nesting level get resolved by up to this many threads (0: one per core).
+///             The definitions get added in the same order regardless.
+/// @param load_compounds if given, gets called (once per nesting level) with the refids of the types not found in
+///                       class_compounds yet, to add them to class_compounds on demand (see ASTs::load_class_compounds).
+/// @throws shared_class_error listing all classes of a nesting level which could not be resolved.
+extern void find_class_definitions(const std::unordered_map<std::string, class_compound> &class_compounds,
                                    const std::vector<SharedVariable> &shared_vars,
-                                   std::unordered_map<std::string, shared_class_definition> &class_definitions);
+                                   type_table &types, size_t jobs = 1,
+                                   const class_compound_loader &load_compounds = class_compound_loader());
 
 } } // namespace inexor::gluegen
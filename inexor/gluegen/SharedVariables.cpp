@@ -1,6 +1,7 @@
 
 #include "inexor/gluegen/SharedVariables.hpp"
 #include "inexor/gluegen/parse_helpers.hpp"
+#include "inexor/gluegen/marker_prescan.hpp"
 
 #include <kainjow/mustache.hpp>
 
@@ -10,6 +11,8 @@
 #include <pugixml.hpp>
 
 #include <string>
+#include <cctype>
+#include <cstring>
 
 
 using std::string;
@@ -24,15 +27,45 @@ namespace inexor { namespace gluegen {
 
 vector<string> reflection_marker_searchstrings;
 
-/// Returns true if this node is marked to be shared.
-bool is_marked_variable(const xml_node &member_xml)
+/// All reflection_marker_searchstrings compiled into one matcher.
+static marker_matcher reflection_markers{vector<string>()};
+
+void set_reflection_markers(const vector<string> &markers)
 {
-    for (const string &search : reflection_marker_searchstrings)
-        if(contains(get_complete_xml_text(member_xml.child("initializer")), search))
+    reflection_marker_searchstrings = markers;
+    reflection_markers = marker_matcher(markers);
+}
+
+size_t find_reflection_marker(const string &initializer)
+{
+    return reflection_markers.find(initializer);
+}
+
+/// Feeds the text of the node to the matcher in the order get_complete_xml_text concatenates it.
+bool feed_xml_text(const xml_node &parent, marker_matcher::state &s, size_t &marker_pos)
+{
+    for(pugi::xml_node child : parent.children())
+    {
+        if(child.type() == pugi::node_pcdata)
+        {
+            const char *text = child.value();
+            if(reflection_markers.feed(s, text, std::strlen(text), marker_pos)) return true;
+        }
+        else if(!child.first_child().empty() && feed_xml_text(child, s, marker_pos))
             return true;
+    }
     return false;
 }
 
+bool find_reflection_marker(const xml_node &member_xml, string &initializer, size_t &marker_pos)
+{
+    const xml_node initializer_xml = member_xml.child("initializer");
+    marker_matcher::state s;
+    if(!feed_xml_text(initializer_xml, s, marker_pos)) return false;
+    initializer = get_complete_xml_text(initializer_xml);
+    return true;
+}
+
 /// Returns the vector of the namespace of this AST xml, split by ::
 /// There are different AST xmls for not namespaced code and code inside namespaces.
 const vector<string> get_namespace_of_namespace_file(const xml_node compound_xml)
@@ -176,20 +209,53 @@ unordered_map<string, SharedVariable::attached_attribute> parse_attached_attribu
     return attributes;
 }
 
+/// The attached attributes are passed to the reflection_marking.. function as function parameters.
+/// If the marker is not followed by such a call, we take the first bracket of the initializer.
+string get_attached_attributes_literal(const string &initializer, size_t marker_pos)
+{
+    size_t call_pos = marker_pos;
+    for(; call_pos < initializer.size(); call_pos++)
+    {
+        const unsigned char c = initializer[call_pos];
+        if(!isalnum(c) && c != '_' && c != ':') break;
+    }
+    while(call_pos < initializer.size() && isspace(static_cast<unsigned char>(initializer[call_pos])))
+        call_pos++;
+    if(call_pos >= initializer.size() || initializer[call_pos] != '(') call_pos = 0;
+
+    string dummy;
+    return parse_bracket(call_pos ? initializer.substr(call_pos) : initializer, dummy, dummy);
+}
+
+/// Returns the (longest) reflection marker starting at marker_pos.
+string get_reflection_marker_at(const string &initializer, size_t marker_pos)
+{
+    string marker;
+    for(const string &search : reflection_marker_searchstrings)
+        if(search.size() > marker.size() && initializer.compare(marker_pos, search.size(), search) == 0)
+            marker = search;
+    return marker;
+}
+
 /// Takes xml variable nodes and returns a new SharedVar according to it.
-SharedVariable::SharedVariable(const xml_node &var_xml, const vector<string> &var_namespace) :
+SharedVariable::SharedVariable(const xml_node &var_xml, const vector<string> &var_namespace,
+                               const string &initializer, size_t marker_pos) :
         name(get_complete_xml_text(var_xml.child("name"))), var_namespace(var_namespace)
 {
     // e.g. SharedVar<int>
-    const string type_lit = get_complete_xml_text(var_xml.child("type"));
     auto type_childs = var_xml.child("type").children();
     type = type_parser(vector<xml_node>(type_childs.begin(), type_childs.end()));
 
-    // The attached attributes are passed to the reflection_marking.. function as function parameters.
-    string initializer = get_complete_xml_text(var_xml.child("initializer"));
-    string dummy;
-    string attached_attributes_literal = parse_bracket(initializer, dummy, dummy);
-    attached_attributes = parse_attached_attributes_string(attached_attributes_literal);
+    attached_attributes = parse_attached_attributes_string(get_attached_attributes_literal(initializer, marker_pos));
+    reflection_marker = get_reflection_marker_at(initializer, marker_pos);
+}
+
+SharedVariable::SharedVariable(const type_node_t &type, const string &name, const vector<string> &var_namespace,
+                               const string &initializer, size_t marker_pos) :
+        type(type), name(name), var_namespace(var_namespace)
+{
+    attached_attributes = parse_attached_attributes_string(get_attached_attributes_literal(initializer, marker_pos));
+    reflection_marker = get_reflection_marker_at(initializer, marker_pos);
 }
 
 /// Find all marked shared vars inside a given document AST.
@@ -214,24 +280,14 @@ void find_shared_var_occurences(const pugi::xml_node &compound_xml, std::vector<
         {
             for(const auto &member_xml : section.children("memberdef"))
             {
-                if(is_marked_variable(member_xml)) {
-                    output_list.push_back(SharedVariable{member_xml, ns_of_vars});
+                string initializer;
+                size_t marker_pos;
+                if(find_reflection_marker(member_xml, initializer, marker_pos)) {
+                    output_list.push_back(SharedVariable{member_xml, ns_of_vars, initializer, marker_pos});
                 }
             }
         }
     }
 }
 
-const std::vector<SharedVariable> find_shared_var_occurences(const std::vector<std::unique_ptr<pugi::xml_document>> &AST_code_xmls)
-{
-    std::vector<SharedVariable> buf;
-    for(const std::unique_ptr<pugi::xml_document> &fileast : AST_code_xmls)
-    {
-        const xml_node compound_xml = fileast->child("doxygen").child("compounddef");
-        find_shared_var_occurences(compound_xml, buf);
-    }
-    return buf;
-}
-
-
 } } // namespace inexor::gluegen
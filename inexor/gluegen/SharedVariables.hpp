@@ -33,19 +33,6 @@ struct SharedVariable
 
         std::vector<type_node_t> template_types;
         type_node_t *parent = nullptr;
-
-        std::string uniqueID() const
-        {
-            std::string buf = refid;
-            for (size_t i = 0; i < template_types.size(); i++)
-            {
-                if (i == 0) buf += "<";
-                buf += template_types[i].uniqueID();
-                if (i==template_types.size()-1) buf += ">";
-                else buf += ",";
-            }
-            return buf;
-        }
     };
 
     /// A Sharedattribute instance **used** when instancing a variable or class.
@@ -71,19 +58,43 @@ struct SharedVariable
     /// All attributes attached when instancing this variable.
     std::unordered_map<std::string, attached_attribute> attached_attributes;
 
+    /// The reflection marker this variable got marked with (the first one in its initializer).
+    std::string reflection_marker;
+
     /// Constructs a new SharedVar after parsing a xml variable node.
-    SharedVariable(const pugi::xml_node &var_xml, const std::vector<std::string> &var_namespace);
+    /// @param initializer the text of the initializer node and marker_pos where the reflection marker starts in it,
+    ///        as returned by find_reflection_marker.
+    SharedVariable(const pugi::xml_node &var_xml, const std::vector<std::string> &var_namespace,
+                   const std::string &initializer, size_t marker_pos);
+
+    /// Constructs a SharedVar from the parts of its declaration, used when scanning the sources without doxygen.
+    /// @param initializer everything behind the name, e.g. "= reflection_mark(NoSync()|Persistent())".
+    SharedVariable(const type_node_t &type, const std::string &name, const std::vector<std::string> &var_namespace,
+                   const std::string &initializer, size_t marker_pos);
+
+    /// Constructs a SharedVar without type and attributes, used when restoring it from the extraction cache.
+    SharedVariable(const std::string &name, const std::vector<std::string> &var_namespace)
+        : name(name), var_namespace(var_namespace) {}
 
 };
 
-/// Find all marked global variables inside a bunch of AST xml files (as spit out by doxygen) and save them in a vector.
-extern const std::vector<SharedVariable> find_shared_var_occurences(const std::vector<std::unique_ptr<pugi::xml_document>> &AST_code_xmls);
+/// Find all marked global variables inside the compounddef node of a code AST xml file (as spit out by doxygen)
+/// and append them to output_list.
+extern void find_shared_var_occurences(const pugi::xml_node &compound_xml, std::vector<SharedVariable> &output_list);
 
 /// If one of these strings is in the initializer of a variable, it is marked for reflection and
 /// gets recognized by the gluegen tool.
+/// @note set them with set_reflection_markers.
 extern std::vector<std::string> reflection_marker_searchstrings;
 
+/// Sets the reflection_marker_searchstrings and compiles them for find_reflection_marker.
+extern void set_reflection_markers(const std::vector<std::string> &markers);
+
 /// Returns true if this node is marked to be shared.
-extern bool is_marked_variable(const pugi::xml_node &member_xml);
+/// The initializer text is only extracted in that case, marker_pos is where the first marker starts in it.
+extern bool find_reflection_marker(const pugi::xml_node &member_xml, std::string &initializer, size_t &marker_pos);
+
+/// Returns where the first reflection marker starts in this initializer of a variable or std::string::npos.
+extern size_t find_reflection_marker(const std::string &initializer);
 
 } } // namespace inexor::gluegen
@@ -0,0 +1,256 @@
+#include "inexor/gluegen/bench/corpus_generator.hpp"
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::to_string;
+using std::vector;
+using inexor::filesystem::Path;
+
+namespace inexor { namespace gluegen { namespace bench {
+
+const char corpus_reflection_marker[] = "bench_mark";
+
+/// Escapes the chars xml does not allow in text and attribute values.
+static string xml_escape(const string &text)
+{
+    string escaped;
+    escaped.reserve(text.size());
+    for(const char c : text)
+    {
+        switch(c)
+        {
+            case '&': escaped += "&amp;"; break;
+            case '<': escaped += "&lt;"; break;
+            case '>': escaped += "&gt;"; break;
+            case '"': escaped += "&quot;"; break;
+            default: escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static bool write_xml_file(const Path &file, const string &body)
+{
+    std::ofstream out(file.string(), std::ios::binary);
+    out << "<?xml version='1.0' encoding='UTF-8' standalone='no'?>\n"
+           "<doxygen xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" version=\"1.8.13\">\n"
+        << body << "</doxygen>\n";
+    return static_cast<bool>(out);
+}
+
+static string class_refid(size_t k) { return "classbench_1_1Class" + to_string(k); }
+static string class_name(size_t k) { return "bench::Class" + to_string(k); }
+
+static const char wrapper_refid[] = "classbench_1_1Wrapper";
+
+/// The type of a variable of class k, wrapped depth times in bench::Wrapper<..> (as doxygen writes it).
+static string class_type_xml(size_t k, size_t depth)
+{
+    string type;
+    for(size_t i = 0; i < depth; i++)
+        type += string("<ref refid=\"") + wrapper_refid + "\" kindref=\"compound\">bench::Wrapper</ref>&lt; ";
+    type += "<ref refid=\"" + class_refid(k) + "\" kindref=\"compound\">" + class_name(k) + "</ref>";
+    for(size_t i = 0; i < depth; i++)
+        type += " &gt;";
+    return type;
+}
+
+static const char builtin_type_xml[] = "<ref refid=\"classSharedVar\" kindref=\"compound\">SharedVar</ref>&lt; int &gt;";
+
+/// The initializer of the i-th marked variable: the marker call with the attached attributes.
+/// The arguments alternate between (hex or decimal) integers and strings with escape sequences.
+static string marked_initializer(size_t i, size_t attributes)
+{
+    string attached;
+    const size_t count = attributes ? i % (attributes + 1) : 0;
+    for(size_t j = 0; j < count; j++)
+    {
+        if(j) attached += "|";
+        attached += "BenchAttr" + to_string((i + j) % attributes) + "(";
+        if((i + j) % 2) attached += "\"v" + to_string(i) + "\\tx\"";
+        else if(i % 3 == 0)
+        {
+            static const char hex_digits[] = "0123456789abcdef";
+            string hex;
+            for(size_t n = i; n || hex.empty(); n /= 16) hex.insert(hex.begin(), hex_digits[n % 16]);
+            attached += "0x" + hex;
+        }
+        else attached += to_string(i);
+        attached += ")";
+    }
+    return xml_escape(string("= ") + corpus_reflection_marker + "(" + attached + ")");
+}
+
+static string marked_member_xml(const string &id, const string &type_xml, const string &name,
+                                const string &initializer, const string &file)
+{
+    return "      <memberdef kind=\"variable\" id=\"" + id + "\" prot=\"public\" static=\"no\" mutable=\"no\">\n"
+           "        <type>" + type_xml + "</type>\n"
+           "        <name>" + name + "</name>\n"
+           "        <initializer>" + initializer + "</initializer>\n"
+           "        <briefdescription>\n        </briefdescription>\n"
+           "        <detaileddescription>\n        </detaileddescription>\n"
+           "        <location file=\"" + file + "\" line=\"1\" column=\"1\"/>\n"
+           "      </memberdef>\n";
+}
+
+/// A namespace of the tree, the parts are the indices of the namespace on each level.
+struct corpus_namespace
+{
+    vector<size_t> parts;
+
+    string refid() const
+    {
+        string id = "namespacebench";
+        for(const size_t part : parts) id += "_1_1n" + to_string(part);
+        return id;
+    }
+
+    string name() const
+    {
+        string full_name = "bench";
+        for(const size_t part : parts) full_name += "::n" + to_string(part);
+        return full_name;
+    }
+
+    string file() const
+    {
+        string path = "bench";
+        for(const size_t part : parts) path += "/n" + to_string(part);
+        return path + ".cpp";
+    }
+};
+
+static string index_entry(const string &refid, const char *kind, const string &name)
+{
+    return "  <compound refid=\"" + refid + "\" kind=\"" + kind + "\"><name>" + name + "</name></compound>\n";
+}
+
+bool write_corpus(const Path &folder, const corpus_config &config)
+{
+    boost::system::error_code err;
+    boost::filesystem::create_directories(folder, err);
+    string index = "<?xml version='1.0' encoding='UTF-8' standalone='no'?>\n"
+                   "<doxygenindex xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" version=\"1.8.13\">\n";
+
+    // the namespace tree, level by level, the variables go into the leaves.
+    vector<corpus_namespace> namespaces{corpus_namespace()};
+    size_t first_leaf = 0;
+    for(size_t level = 0; level < config.namespace_depth && config.namespace_fanout; level++)
+    {
+        const size_t level_end = namespaces.size();
+        for(size_t parent = first_leaf; parent < level_end; parent++)
+            for(size_t child = 0; child < config.namespace_fanout; child++)
+            {
+                corpus_namespace ns = namespaces[parent];
+                ns.parts.push_back(child);
+                namespaces.push_back(ns);
+            }
+        first_leaf = level_end;
+    }
+    const size_t leaf_count = namespaces.size() - first_leaf;
+
+    for(size_t n = 0; n < namespaces.size(); n++)
+    {
+        const corpus_namespace &ns = namespaces[n];
+        string body = "  <compounddef id=\"" + ns.refid() + "\" kind=\"namespace\" language=\"C++\">\n"
+                      "    <compoundname>" + ns.name() + "</compoundname>\n";
+        if(n >= first_leaf && config.shared_vars > n - first_leaf)
+        {
+            body += "    <sectiondef kind=\"var\">\n";
+            for(size_t i = n - first_leaf; i < config.shared_vars; i += leaf_count)
+            {
+                const string type = i % 2 && config.shared_classes
+                                    ? class_type_xml(i / 2 % config.shared_classes, config.template_depth)
+                                    : string(builtin_type_xml);
+                body += marked_member_xml(ns.refid() + "_1av" + to_string(i), type, "var" + to_string(i),
+                                          marked_initializer(i, config.attributes), ns.file());
+            }
+            body += "    </sectiondef>\n";
+        }
+        body += "    <location file=\"" + ns.file() + "\" line=\"1\" column=\"1\"/>\n  </compounddef>\n";
+        if(!write_xml_file(folder / (ns.refid() + ".xml"), body)) return false;
+        index += index_entry(ns.refid(), "namespace", ns.name());
+    }
+
+    for(size_t k = 0; k < config.shared_classes; k++)
+    {
+        const string file = "bench/class" + to_string(k) + ".hpp";
+        string body = "  <compounddef id=\"" + class_refid(k) + "\" kind=\"class\" language=\"C++\" prot=\"public\">\n"
+                      "    <compoundname>" + class_name(k) + "</compoundname>\n"
+                      "    <sectiondef kind=\"public-attrib\">\n";
+        for(size_t m = 0; m < config.class_members; m++)
+        {
+            const size_t child = 2 * k + 1 + m;
+            const string type = m < 2 && child < config.shared_classes ? class_type_xml(child, 0) : string(builtin_type_xml);
+            body += marked_member_xml(class_refid(k) + "_1am" + to_string(m), type, "member" + to_string(m),
+                                      marked_initializer(k * config.class_members + m, config.attributes), file);
+        }
+        body += "    </sectiondef>\n"
+                "    <location file=\"" + file + "\" line=\"1\" column=\"1\"/>\n  </compounddef>\n";
+        if(!write_xml_file(folder / (class_refid(k) + ".xml"), body)) return false;
+        index += index_entry(class_refid(k), "class", class_name(k));
+    }
+
+    // template<typename T> class Wrapper { public: T value = bench_mark(); };
+    {
+        const string body = string("  <compounddef id=\"") + wrapper_refid + "\" kind=\"class\" language=\"C++\" prot=\"public\">\n"
+                            "    <compoundname>bench::Wrapper</compoundname>\n"
+                            "    <templateparamlist>\n"
+                            "      <param>\n        <type>typename T</type>\n        <declname>T</declname>\n"
+                            "        <defname>T</defname>\n      </param>\n"
+                            "    </templateparamlist>\n"
+                            "    <sectiondef kind=\"public-attrib\">\n"
+                            + marked_member_xml(string(wrapper_refid) + "_1avalue", "T", "value",
+                                                marked_initializer(0, config.attributes), "bench/wrapper.hpp")
+                            + "    </sectiondef>\n"
+                            "    <location file=\"bench/wrapper.hpp\" line=\"1\" column=\"1\"/>\n  </compounddef>\n";
+        if(!write_xml_file(folder / (string(wrapper_refid) + ".xml"), body)) return false;
+        index += index_entry(wrapper_refid, "class", "bench::Wrapper");
+    }
+
+    // class BenchAttrA : public SharedOption
+    // { BenchAttrA(int value, const char *help = "{{name}}: {{index}}"); BenchAttrA(const char *text, int flags = 0x1F); };
+    for(size_t a = 0; a < config.attributes; a++)
+    {
+        const string name = "BenchAttr" + to_string(a);
+        const string refid = "class" + name;
+        auto constructor = [&](const string &id, const string &first_type, const string &first_name,
+                               const string &second_type, const string &second_name, const string &second_default)
+        {
+            return "      <memberdef kind=\"function\" id=\"" + refid + id + "\" prot=\"public\" static=\"no\" const=\"no\" "
+                   "explicit=\"no\" inline=\"no\" virt=\"non-virtual\">\n"
+                   "        <type></type>\n"
+                   "        <name>" + name + "</name>\n"
+                   "        <param>\n          <type>" + first_type + "</type>\n"
+                   "          <declname>" + first_name + "</declname>\n        </param>\n"
+                   "        <param>\n          <type>" + second_type + "</type>\n"
+                   "          <declname>" + second_name + "</declname>\n"
+                   "          <defval>" + xml_escape(second_default) + "</defval>\n        </param>\n"
+                   "      </memberdef>\n";
+        };
+        const string body = "  <compounddef id=\"" + refid + "\" kind=\"class\" language=\"C++\" prot=\"public\">\n"
+                            "    <compoundname>" + name + "</compoundname>\n"
+                            "    <basecompoundref refid=\"classSharedOption\" prot=\"public\" virt=\"non-virtual\">"
+                            "SharedOption</basecompoundref>\n"
+                            "    <sectiondef kind=\"public-func\">\n"
+                            + constructor("_1a0", "int", "value", "const char *", "help", "\"{{name}}: {{index}}\"")
+                            + constructor("_1a1", "const char *", "text", "int", "flags", "0x1F")
+                            + "    </sectiondef>\n"
+                            "    <location file=\"bench/attributes.hpp\" line=\"1\" column=\"1\"/>\n  </compounddef>\n";
+        if(!write_xml_file(folder / (refid + ".xml"), body)) return false;
+        index += index_entry(refid, "class", name);
+    }
+
+    index += "</doxygenindex>\n";
+    std::ofstream index_out((folder / "index.xml").string(), std::ios::binary);
+    index_out << index;
+    return static_cast<bool>(index_out);
+}
+
+} } } // namespace inexor::gluegen::bench
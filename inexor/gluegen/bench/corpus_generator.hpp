@@ -0,0 +1,40 @@
+#pragma once
+
+#include "inexor/filesystem/path.hpp"
+
+#include <string>
+
+namespace inexor { namespace gluegen { namespace bench {
+
+/// The size and shape of a synthetic doxygen AST, see write_corpus.
+struct corpus_config
+{
+    /// The number of marked variables at namespace scope, every second one has a class type.
+    size_t shared_vars = 1000;
+
+    /// The number of shared classes. They form a binary tree: class k has members of the classes 2k+1 and 2k+2.
+    size_t shared_classes = 100;
+
+    /// The number of marked members of each class (including the ones of the child classes).
+    size_t class_members = 4;
+
+    /// How often the class typed variables are wrapped in the template class bench::Wrapper<T>, 0 = not at all.
+    size_t template_depth = 1;
+
+    /// The number of SharedOption classes, variable i gets i % (attributes + 1) of them attached.
+    size_t attributes = 4;
+
+    /// The variables get spread over the leaves of a namespace tree with this many children per namespace ..
+    size_t namespace_fanout = 4;
+    /// .. and this many levels below the namespace "bench".
+    size_t namespace_depth = 2;
+};
+
+/// The reflection marker the variables of the corpus are marked with.
+extern const char corpus_reflection_marker[];
+
+/// Writes the doxygen xml files (including the index.xml) of a synthetic code base into the folder.
+/// @return false if a file could not be written.
+extern bool write_corpus(const inexor::filesystem::Path &folder, const corpus_config &config);
+
+} } } // namespace inexor::gluegen::bench
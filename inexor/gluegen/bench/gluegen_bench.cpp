@@ -0,0 +1,319 @@
+/// Benchmarks the stages of the gluegen on synthetic doxygen ASTs of growing size (see corpus_generator.hpp)
+/// and writes the results as json, so gluegen versions can be compared.
+
+#include "inexor/gluegen/bench/corpus_generator.hpp"
+#include "inexor/gluegen/ASTs.hpp"
+#include "inexor/gluegen/SharedVariables.hpp"
+#include "inexor/gluegen/SharedVarDatatypes.hpp"
+#include "inexor/gluegen/print_data.hpp"
+#include "inexor/gluegen/render_files.hpp"
+#include "inexor/gluegen/template_keys.hpp"
+#include "inexor/gluegen/parse_helpers.hpp"
+#include "inexor/gluegen/stage_timings.hpp"
+#include "inexor/gluegen/binary_records.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <pugiconfig.hpp>
+#include <pugixml.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace inexor::gluegen;
+using namespace inexor::gluegen::bench;
+using inexor::filesystem::Path;
+namespace po = boost::program_options;
+namespace bfs = boost::filesystem;
+using std::string;
+using std::vector;
+
+/// The template rendered by the render_files benchmark, using every part of the template data.
+static const char bench_template[] =
+    "{{file_comment}}\n"
+    "{{#variables}}{{index}} {{type_name_cpp}} {{name}} {{path}}"
+    "{{#attached_attributes}} {{attr_name}}({{#attr_constructor_args}}{{attr_arg_name}}={{attr_arg_value}} "
+    "{{/attr_constructor_args}}){{/attached_attributes}}\n{{/variables}}"
+    "{{#type_definitions}}class {{type_name_unique}} in {{header}}:"
+    "{{#members}} {{type_name_cpp}} {{name}}{{/members}}\n{{/type_definitions}}"
+    "{{#attribute_definitions}}{{name}}{{#constructor_args}} {{arg_name}}={{arg_id}}{{/constructor_args}}\n"
+    "{{/attribute_definitions}}";
+
+/// The milliseconds the function took.
+static double measure_ms(const std::function<void()> &function)
+{
+    const stage_timings::clock::time_point start = stage_timings::clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(stage_timings::clock::now() - start).count();
+}
+
+/// The results for one corpus size, every stage with the fastest of all repetitions.
+struct size_result
+{
+    corpus_config config;
+    size_t corpus_bytes = 0;
+    vector<std::pair<string, double>> stage_ms;
+    vector<std::pair<string, size_t>> counts;
+
+    void add_stage(const string &name, double ms)
+    {
+        for(auto &stage : stage_ms)
+            if(stage.first == name)
+            {
+                stage.second = std::min(stage.second, ms);
+                return;
+            }
+        stage_ms.emplace_back(name, ms);
+    }
+
+    void set_count(const string &name, size_t count)
+    {
+        for(auto &entry : counts)
+            if(entry.first == name)
+            {
+                entry.second = count;
+                return;
+            }
+        counts.emplace_back(name, count);
+    }
+};
+
+/// Runs all stages once on the corpus, in the order the gluegen runs them.
+static void run_stages(const Path &corpus, const Path &output_folder, size_t jobs, size_result &result)
+{
+    const vector<string> markers{corpus_reflection_marker};
+
+    ASTs code;
+    result.add_stage("load_from_directory", measure_ms([&] { code.load_from_directory(corpus, jobs, markers); }));
+
+    // on the already parsed code ASTs, so only the search for the marked variables gets measured.
+    vector<Path> namespace_files;
+    inexor::filesystem::list_files(corpus, namespace_files, ".xml");
+    namespace_files.erase(std::remove_if(namespace_files.begin(), namespace_files.end(), [](const Path &file) {
+        return file.filename().string().compare(0, 9, "namespace") != 0;
+    }), namespace_files.end());
+    vector<std::unique_ptr<pugi::xml_document>> code_asts;
+    for(const Path &file : namespace_files)
+    {
+        code_asts.emplace_back(new pugi::xml_document());
+        code_asts.back()->load_file(file.string().c_str());
+    }
+    vector<SharedVariable> found_vars;
+    result.add_stage("find_shared_var_occurences", measure_ms([&] {
+        for(const auto &ast : code_asts)
+            find_shared_var_occurences(ast->child("doxygen").child("compounddef"), found_vars);
+    }));
+    code_asts.clear();
+
+    type_table types;
+    result.add_stage("find_class_definitions", measure_ms([&] {
+        find_class_definitions(code.class_compounds, code.shared_var_occurences, types, jobs);
+    }));
+
+    template_file templ;
+    templ.files.push_back({"bench_output.txt", bench_template});
+    const vector<template_file> templates{templ};
+
+    kainjow::mustache::data data;
+    result.add_stage("print_data", measure_ms([&] {
+        data = print_data(code.shared_var_occurences, types, code.attribute_definitions,
+                          used_template_keys(vector<string>{bench_template}));
+    }));
+
+    // into an empty folder, otherwise unchanged files would not get written again.
+    boost::system::error_code err;
+    bfs::remove_all(output_folder, err);
+    bfs::create_directories(output_folder, err);
+    result.add_stage("render_files", measure_ms([&] { render_files(data, templates, output_folder.string(), jobs); }));
+
+    result.set_count("shared_variables", code.shared_var_occurences.size());
+    result.set_count("found_shared_variables", found_vars.size());
+    result.set_count("class_compounds", code.class_compounds.size());
+    result.set_count("shared_classes", types.definitions().size());
+    result.set_count("attribute_definitions", code.attribute_definitions.size());
+}
+
+/// The result of a microbenchmark.
+struct micro_result
+{
+    string name;
+    size_t iterations;
+    double ns_per_op;
+};
+
+/// Benchmarks normalize_literal on each kind of literal attribute arguments and default values use.
+static vector<micro_result> benchmark_normalize_literal(size_t iterations)
+{
+    static const std::pair<const char *, const char *> literals[] = {
+        {"decimal", "12345"},
+        {"hex", "0x1F2E"},
+        {"binary_separators_suffix", "0b1010'1010ul"},
+        {"float_suffix", "3.14159f"},
+        {"string", "\"{{name}}: {{index}}\""},
+        {"string_escapes", "\"tab\\t newline\\n hex\\x41 octal\\101 universal\\u00e9\""},
+        {"string_concatenation", "\"abc\" \"def\"  u8\"ghi\""},
+        {"raw_string", "R\"x(raw \\n \"quoted\")x\""},
+        {"expression", "some_function(1, 2) + 3"},
+    };
+    vector<micro_result> results;
+    volatile size_t sink = 0; // keeps the calls from getting optimized away.
+    for(const auto &literal : literals)
+    {
+        const string input = literal.second;
+        const double ms = measure_ms([&] {
+            for(size_t i = 0; i < iterations; i++) sink += normalize_literal(input).size();
+        });
+        results.push_back({string("normalize_literal/") + literal.first, iterations, ms * 1e6 / iterations});
+    }
+    return results;
+}
+
+static string json_string(const string &str)
+{
+    string quoted = "\"";
+    for(const char c : str)
+    {
+        if(c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static string results_json(const vector<size_result> &results, const vector<micro_result> &micro_results,
+                           size_t jobs, size_t repetitions)
+{
+    std::ostringstream json;
+    json << "{\n  \"gluegen_version\": " << json_string(gluegen_version) << ",\n  \"jobs\": " << jobs
+         << ",\n  \"repetitions\": " << repetitions << ",\n  \"runs\": [";
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const size_result &result = results[i];
+        const corpus_config &c = result.config;
+        json << (i ? ",\n" : "\n") << "    {\"shared_vars\": " << c.shared_vars << ", \"shared_classes\": " << c.shared_classes
+             << ", \"class_members\": " << c.class_members << ", \"template_depth\": " << c.template_depth
+             << ", \"attributes\": " << c.attributes << ", \"namespace_fanout\": " << c.namespace_fanout
+             << ", \"namespace_depth\": " << c.namespace_depth << ", \"corpus_bytes\": " << result.corpus_bytes
+             << ",\n     \"stages_ms\": {";
+        for(size_t s = 0; s < result.stage_ms.size(); s++)
+            json << (s ? ", " : "") << json_string(result.stage_ms[s].first) << ": " << result.stage_ms[s].second;
+        json << "},\n     \"counts\": {";
+        for(size_t s = 0; s < result.counts.size(); s++)
+            json << (s ? ", " : "") << json_string(result.counts[s].first) << ": " << result.counts[s].second;
+        json << "}}";
+    }
+    json << "\n  ],\n  \"microbenchmarks\": [";
+    for(size_t i = 0; i < micro_results.size(); i++)
+        json << (i ? ",\n" : "\n") << "    {\"name\": " << json_string(micro_results[i].name)
+             << ", \"iterations\": " << micro_results[i].iterations << ", \"ns_per_op\": " << micro_results[i].ns_per_op << "}";
+    json << "\n  ]\n}\n";
+    return json.str();
+}
+
+int main(int argc, const char **argv)
+{
+    po::variables_map cli_config;
+    po::options_description params("PARAMETERS");
+    params.add_options()
+        ("help", "Print this help message")
+        ("sizes", po::value<vector<size_t>>()->multitoken()->default_value({1000, 10000, 100000, 1000000}, "1000 .. 1000000"),
+              "The numbers of marked variables to benchmark the stages with, one corpus each.")
+        ("vars_per_class", po::value<size_t>()->default_value(10), "The number of shared classes is the number of "
+              "variables divided by this.")
+        ("class_members", po::value<size_t>()->default_value(4), "The number of marked members of each class.")
+        ("template_depth", po::value<size_t>()->default_value(1), "How deep the class typed variables are nested in "
+              "template instances.")
+        ("attributes", po::value<size_t>()->default_value(4), "The number of attribute classes, each variable gets up "
+              "to this many of them attached.")
+        ("namespace_fanout", po::value<size_t>()->default_value(4), "The number of child namespaces of each namespace.")
+        ("namespace_depth", po::value<size_t>()->default_value(2), "The number of namespace levels.")
+        ("jobs", po::value<size_t>()->default_value(1), "The number of threads used by the stages supporting it.\n"
+              "0 uses one thread per hardware thread.")
+        ("repetitions", po::value<size_t>()->default_value(1), "How often the stages run on each corpus, "
+              "the fastest run gets reported.")
+        ("work_dir", po::value<string>()->default_value((bfs::temp_directory_path() / "gluegen_bench").string()),
+              "The folder the corpora and the rendered files get written to.")
+        ("keep_corpus", "Do not delete the generated corpora afterwards.")
+        ("literal_iterations", po::value<size_t>()->default_value(200000), "How often normalize_literal gets called "
+              "on each kind of literal in its microbenchmark, 0 skips it.")
+        ("output", po::value<string>()->default_value("gluegen_bench.json"), "The json file the results get written to.");
+
+    try {
+        po::store(po::command_line_parser(argc, argv).options(params).run(), cli_config);
+        if(cli_config.count("help"))
+        {
+            std::cerr << "Benchmarks the gluegen stages on synthetic doxygen ASTs.\n\n" << params << "\n";
+            return 0;
+        }
+        po::notify(cli_config);
+    }
+    catch(po::error &e) {
+        std::cerr << "Failed to parse the args: " << e.what() << "\n\n" << params << "\n";
+        return 1;
+    }
+
+    const size_t jobs = cli_config["jobs"].as<size_t>();
+    const size_t repetitions = std::max<size_t>(1, cli_config["repetitions"].as<size_t>());
+    const size_t vars_per_class = std::max<size_t>(1, cli_config["vars_per_class"].as<size_t>());
+    const Path work_dir = cli_config["work_dir"].as<string>();
+    const string output_file = cli_config["output"].as<string>();
+    set_reflection_markers({corpus_reflection_marker});
+
+    const size_t literal_iterations = cli_config["literal_iterations"].as<size_t>();
+    const vector<micro_result> micro_results = literal_iterations ? benchmark_normalize_literal(literal_iterations)
+                                                                  : vector<micro_result>();
+
+    vector<size_result> results;
+    for(const size_t size : cli_config["sizes"].as<vector<size_t>>())
+    {
+        size_result result;
+        corpus_config &config = result.config;
+        config.shared_vars = size;
+        config.shared_classes = std::max<size_t>(1, size / vars_per_class);
+        config.class_members = cli_config["class_members"].as<size_t>();
+        config.template_depth = cli_config["template_depth"].as<size_t>();
+        config.attributes = cli_config["attributes"].as<size_t>();
+        config.namespace_fanout = cli_config["namespace_fanout"].as<size_t>();
+        config.namespace_depth = cli_config["namespace_depth"].as<size_t>();
+
+        std::cerr << "Benchmarking " << size << " shared variables, " << config.shared_classes << " classes" << std::endl;
+        const Path corpus = work_dir / ("corpus_" + std::to_string(size));
+        boost::system::error_code err;
+        bfs::remove_all(corpus, err);
+        bool written = false;
+        result.add_stage("generate_corpus", measure_ms([&] { written = write_corpus(corpus, config); }));
+        if(!written)
+        {
+            std::cerr << "Could not write the corpus to " << corpus << std::endl;
+            return 1;
+        }
+        inexor::filesystem::walk_directory(corpus, [&](const Path &file) {
+            result.corpus_bytes += static_cast<size_t>(bfs::file_size(file));
+        });
+
+        for(size_t i = 0; i < repetitions; i++)
+            run_stages(corpus, work_dir / "output", jobs, result);
+        result.set_count("peak_rss_bytes", peak_rss_bytes());
+        results.push_back(result);
+
+        if(!cli_config.count("keep_corpus")) bfs::remove_all(corpus, err);
+        // written after every size, so the results of the smaller sizes survive an aborted run.
+        std::ofstream out(output_file, std::ios::binary);
+        out << results_json(results, micro_results, jobs, repetitions);
+        if(!out)
+        {
+            std::cerr << "Could not write the results to " << output_file << std::endl;
+            return 1;
+        }
+    }
+    std::cerr << "Results written to " << output_file << std::endl;
+    return 0;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace inexor { namespace gluegen {
+
+#ifndef GLUEGEN_VERSION
+#error "GLUEGEN_VERSION gets defined by the build, see inexor/gluegen/CMakeLists.txt"
+#endif
+
+/// The version of the gluegen (from conanfile.py), records of a different version are never used.
+const char gluegen_version[] = GLUEGEN_VERSION;
+
+/// 64 bit FNV-1a, continuing from hash.
+inline uint64_t fnv1a_hash(const char *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/// The name of the file a record with this key is stored in, e.g. "00ff00ff00ff00ff.extract".
+inline std::string record_file_name(uint64_t key, const char *extension)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return name + std::string(extension);
+}
+
+/// Appends the binary representation of values to a buffer.
+/// @note values are written in host byte order, the records are not meant to be shared between machines.
+struct record_writer
+{
+    std::string buffer;
+
+    void write_raw(const void *data, size_t size) { buffer.append(static_cast<const char *>(data), size); }
+    void write_u8(uint8_t value) { write_raw(&value, sizeof(value)); }
+    void write_u32(uint32_t value) { write_raw(&value, sizeof(value)); }
+    void write_string(const std::string &str)
+    {
+        write_u32(static_cast<uint32_t>(str.size()));
+        write_raw(str.data(), str.size());
+    }
+    void write_strings(const std::vector<std::string> &strings)
+    {
+        write_u32(static_cast<uint32_t>(strings.size()));
+        for(const std::string &str : strings) write_string(str);
+    }
+    /// Every record starts with 4 magic bytes identifying the kind of record and its format version.
+    void write_header(const char (&magic)[4], uint32_t format_version)
+    {
+        write_raw(magic, sizeof(magic));
+        write_u32(format_version);
+    }
+};
+
+/// Reads values written by record_writer, ok turns false as soon as we read past the end.
+struct record_reader
+{
+    const char *pos;
+    const char *end;
+    bool ok = true;
+
+    record_reader(const char *data, size_t size) : pos(data), end(data + size) {}
+
+    void read_raw(void *out, size_t size)
+    {
+        if(!ok || static_cast<size_t>(end - pos) < size)
+        {
+            ok = false;
+            return;
+        }
+        std::memcpy(out, pos, size);
+        pos += size;
+    }
+    uint8_t read_u8() { uint8_t value = 0; read_raw(&value, sizeof(value)); return value; }
+    uint32_t read_u32() { uint32_t value = 0; read_raw(&value, sizeof(value)); return value; }
+    std::string read_string()
+    {
+        const uint32_t size = read_u32();
+        if(!ok || static_cast<size_t>(end - pos) < size)
+        {
+            ok = false;
+            return std::string();
+        }
+        std::string str(pos, size);
+        pos += size;
+        return str;
+    }
+    std::vector<std::string> read_strings()
+    {
+        std::vector<std::string> strings;
+        for(uint32_t i = 0, count = read_u32(); ok && i < count; i++)
+            strings.push_back(read_string());
+        return strings;
+    }
+
+    /// Returns true if the record starts with the given header (see record_writer::write_header).
+    bool read_header(const char (&magic)[4], uint32_t format_version)
+    {
+        char read_magic[4];
+        read_raw(read_magic, sizeof(read_magic));
+        return ok && std::memcmp(read_magic, magic, sizeof(magic)) == 0 && read_u32() == format_version && ok;
+    }
+
+    /// Whether everything got read without error.
+    bool done() const { return ok && pos == end; }
+};
+
+} } // namespace inexor::gluegen
@@ -0,0 +1,236 @@
+
+#include "inexor/gluegen/extraction_cache.hpp"
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+#include <algorithm>
+
+using std::string;
+using std::vector;
+using namespace inexor::filesystem;
+
+namespace bfs = boost::filesystem;
+
+namespace inexor { namespace gluegen {
+
+/// Increase this whenever the record layout (or what we extract) changes, old records get ignored afterwards.
+/// 3: the default values of attribute constructor args are normalized literals.
+/// 4: the attached attributes come from the argument list of the marker call.
+static const uint32_t extract_format_version = 4;
+static const char extract_magic[4] = {'I', 'G', 'G', 'X'};
+
+/// Deeper nested types than this are considered to be a corrupt record.
+static const size_t max_type_depth = 256;
+
+void write_type_node(record_writer &out, const SharedVariable::type_node_t &type)
+{
+    out.write_string(type.refid);
+    out.write_string(type.pure_type);
+    out.write_u32(static_cast<uint32_t>(type.template_types.size()));
+    for(const auto &template_type : type.template_types)
+        write_type_node(out, template_type);
+}
+
+/// The parent links of the restored nodes stay empty, they are only used while parsing the type.
+void read_type_node(record_reader &in, SharedVariable::type_node_t &type, size_t depth)
+{
+    if(depth > max_type_depth) in.ok = false;
+    type.refid = in.read_string();
+    type.pure_type = in.read_string();
+    for(uint32_t i = 0, count = in.read_u32(); in.ok && i < count; i++)
+    {
+        type.template_types.emplace_back();
+        read_type_node(in, type.template_types.back(), depth + 1);
+    }
+}
+
+void write_shared_vars(record_writer &out, const vector<SharedVariable> &vars)
+{
+    out.write_u32(static_cast<uint32_t>(vars.size()));
+    for(const SharedVariable &var : vars)
+    {
+        out.write_string(var.name);
+        out.write_strings(var.var_namespace);
+        out.write_string(var.reflection_marker);
+        write_type_node(out, var.type);
+        // sorted by name, so the records (and the model file) do not depend on the order of the map.
+        vector<const SharedVariable::attached_attribute *> attributes;
+        for(const auto &attribute : var.attached_attributes) attributes.push_back(&attribute.second);
+        std::sort(attributes.begin(), attributes.end(),
+                  [](const SharedVariable::attached_attribute *a, const SharedVariable::attached_attribute *b) {
+                      return a->name < b->name;
+                  });
+        out.write_u32(static_cast<uint32_t>(attributes.size()));
+        for(const SharedVariable::attached_attribute *attribute : attributes)
+        {
+            out.write_string(attribute->name);
+            out.write_strings(attribute->constructor_args);
+        }
+    }
+}
+
+void read_shared_vars(record_reader &in, vector<SharedVariable> &vars)
+{
+    for(uint32_t i = 0, count = in.read_u32(); in.ok && i < count; i++)
+    {
+        const string name = in.read_string();
+        const vector<string> var_namespace = in.read_strings();
+        SharedVariable var(name, var_namespace);
+        var.reflection_marker = in.read_string();
+        read_type_node(in, var.type);
+        for(uint32_t a = 0, attribute_count = in.read_u32(); in.ok && a < attribute_count; a++)
+        {
+            SharedVariable::attached_attribute attribute;
+            attribute.name = in.read_string();
+            attribute.constructor_args = in.read_strings();
+            var.attached_attributes.emplace(attribute.name, attribute);
+        }
+        vars.push_back(std::move(var));
+    }
+}
+
+void write_attribute(record_writer &out, const attribute_definition &attribute)
+{
+    out.write_string(attribute.name);
+    out.write_u32(static_cast<uint32_t>(attribute.constructors.size()));
+    for(const auto &constructor : attribute.constructors)
+    {
+        out.write_u8(constructor.has_default_values ? 1 : 0);
+        out.write_u32(static_cast<uint32_t>(constructor.constructor_args.size()));
+        for(const function_parameter &arg : constructor.constructor_args)
+        {
+            out.write_string(arg.type);
+            out.write_string(arg.name);
+            out.write_string(arg.default_value);
+        }
+    }
+}
+
+void read_attribute(record_reader &in, attribute_definition &attribute)
+{
+    attribute.name = in.read_string();
+    for(uint32_t i = 0, count = in.read_u32(); in.ok && i < count; i++)
+    {
+        attribute_definition::constructor constructor;
+        constructor.has_default_values = in.read_u8() != 0;
+        for(uint32_t a = 0, arg_count = in.read_u32(); in.ok && a < arg_count; a++)
+        {
+            function_parameter arg;
+            arg.type = in.read_string();
+            arg.name = in.read_string();
+            arg.default_value = in.read_string();
+            constructor.constructor_args.push_back(std::move(arg));
+        }
+        attribute.constructors.push_back(std::move(constructor));
+    }
+}
+
+/// The file the record for key is stored in.
+Path record_path(const Path &directory, uint64_t key)
+{
+    return directory / record_file_name(key, ".extract");
+}
+
+extraction_cache::extraction_cache(const Path &directory, const vector<string> &reflection_markers)
+    : directory(directory)
+{
+    if(!is_enabled()) return;
+
+    boost::system::error_code err;
+    bfs::create_directories(directory, err);
+    if(err)
+    {
+        std::cerr << "Extraction cache directory " << directory << " could not be created, not caching: "
+                  << err.message() << std::endl;
+        this->directory.clear();
+        return;
+    }
+
+    config_hash = fnv1a_hash(gluegen_version, sizeof(gluegen_version));
+    config_hash = fnv1a_hash(reinterpret_cast<const char *>(&extract_format_version), sizeof(extract_format_version), config_hash);
+    for(const string &marker : reflection_markers)
+        config_hash = fnv1a_hash(marker.c_str(), marker.size() + 1, config_hash); // including the \0 as separator.
+}
+
+uint64_t extraction_cache::key_of(const char *data, size_t size) const
+{
+    return fnv1a_hash(data, size, config_hash);
+}
+
+void write_extract(record_writer &out, const AST_file_extract &extract)
+{
+    out.write_u8(static_cast<uint8_t>(extract.kind));
+    switch(extract.kind)
+    {
+        case AST_file_extract::NOTHING:
+            break;
+        case AST_file_extract::CODE:
+            write_shared_vars(out, extract.shared_vars);
+            break;
+        case AST_file_extract::CLASS:
+            out.write_string(extract.compound.refid);
+            out.write_string(extract.compound.full_name);
+            out.write_string(extract.compound.definition_header);
+            out.write_strings(extract.compound.template_params);
+            write_shared_vars(out, extract.compound.marked_members);
+            break;
+        case AST_file_extract::ATTRIBUTE_CLASS:
+            write_attribute(out, extract.attribute);
+            break;
+    }
+}
+
+bool read_extract(record_reader &in, AST_file_extract &extract)
+{
+    extract.kind = static_cast<AST_file_extract::kind_t>(in.read_u8());
+    switch(extract.kind)
+    {
+        case AST_file_extract::NOTHING:
+            break;
+        case AST_file_extract::CODE:
+            read_shared_vars(in, extract.shared_vars);
+            break;
+        case AST_file_extract::CLASS:
+            extract.compound.refid = in.read_string();
+            extract.compound.full_name = in.read_string();
+            extract.compound.definition_header = in.read_string();
+            extract.compound.template_params = in.read_strings();
+            read_shared_vars(in, extract.compound.marked_members);
+            break;
+        case AST_file_extract::ATTRIBUTE_CLASS:
+            read_attribute(in, extract.attribute);
+            break;
+        default:
+            return false;
+    }
+    return in.ok;
+}
+
+bool extraction_cache::load(uint64_t key, AST_file_extract &extract) const
+{
+    mapped_file record(record_path(directory, key));
+    if(!record.is_open()) return false;
+
+    record_reader in(record.data(), record.size());
+    if(!in.read_header(extract_magic, extract_format_version)) return false;
+
+    AST_file_extract loaded;
+    if(!read_extract(in, loaded) || !in.done()) return false;
+
+    extract = std::move(loaded);
+    return true;
+}
+
+void extraction_cache::store(uint64_t key, const AST_file_extract &extract) const
+{
+    record_writer out;
+    out.write_header(extract_magic, extract_format_version);
+    write_extract(out, extract);
+
+    // the record gets moved in place, so a concurrent run never reads a half written one.
+    if(!write_file_atomically(record_path(directory, key), out.buffer.data(), out.buffer.size()))
+        std::cerr << "Could not write extraction cache record " << record_path(directory, key) << std::endl;
+}
+
+} } // namespace inexor::gluegen
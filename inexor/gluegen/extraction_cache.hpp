@@ -0,0 +1,55 @@
+#pragma once
+
+#include "inexor/filesystem/path.hpp"
+#include "inexor/gluegen/ASTs.hpp"
+#include "inexor/gluegen/binary_records.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace inexor { namespace gluegen {
+
+/// A directory containing the extracts of doxygen AST files, keyed by the hash of the file contents.
+///
+/// Each extract is stored in a compact binary record of its own, so rerunning the gluegen only needs to parse the
+/// files which changed since the last run.
+/// The key includes the reflection markers, since they influence what we extract.
+/// @note The records are written in host byte order, the cache is not meant to be shared between machines.
+class extraction_cache
+{
+    inexor::filesystem::Path directory;
+
+    /// The hash of everything influencing the extract besides the file contents.
+    uint64_t config_hash = 0;
+
+public:
+    /// An empty directory disables the cache, otherwise it gets created if necessary.
+    extraction_cache(const inexor::filesystem::Path &directory, const std::vector<std::string> &reflection_markers);
+
+    bool is_enabled() const { return !directory.empty(); }
+
+    /// The key of a file with the given contents.
+    uint64_t key_of(const char *data, size_t size) const;
+
+    /// Loads the extract stored for this key. Returns false if there is none (or it is unreadable).
+    bool load(uint64_t key, AST_file_extract &extract) const;
+
+    /// Stores the extract for this key, replacing any previous one.
+    /// Safe to be called concurrently for different keys.
+    void store(uint64_t key, const AST_file_extract &extract) const;
+};
+
+/// The record layouts of the extracted parts, the model and shard files use them as well.
+/// The readers set in.ok to false on a corrupt record.
+extern void write_type_node(record_writer &out, const SharedVariable::type_node_t &type);
+extern void read_type_node(record_reader &in, SharedVariable::type_node_t &type, size_t depth = 0);
+extern void write_shared_vars(record_writer &out, const std::vector<SharedVariable> &vars);
+extern void read_shared_vars(record_reader &in, std::vector<SharedVariable> &vars);
+extern void write_attribute(record_writer &out, const attribute_definition &attribute);
+extern void read_attribute(record_reader &in, attribute_definition &attribute);
+extern void write_extract(record_writer &out, const AST_file_extract &extract);
+/// @return false if the extract is corrupt.
+extern bool read_extract(record_reader &in, AST_file_extract &extract);
+
+} } // namespace inexor::gluegen
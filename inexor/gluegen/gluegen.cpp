@@ -5,6 +5,10 @@
 #include "inexor/gluegen/SharedVariables.hpp"
 #include "inexor/gluegen/SharedVarDatatypes.hpp"
 #include "inexor/gluegen/ASTs.hpp"
+#include "inexor/gluegen/model_file.hpp"
+#include "inexor/gluegen/parse_helpers.hpp"
+#include "inexor/gluegen/stage_timings.hpp"
+#include "inexor/filesystem/file_watcher.hpp"
 
 #include <boost/program_options.hpp>
 
@@ -15,6 +19,8 @@
 #include <string>
 #include <algorithm>
 #include <vector>
+#include <chrono>
+#include <stdexcept>
 
 
 using namespace inexor::gluegen;
@@ -32,6 +38,124 @@ void usage(const std::string &ex, const po::options_description &params) {
 }
 
 
+/// Renders the templates with the shared declarations and their resolved classes.
+void render_model(const vector<SharedVariable> &shared_vars, type_table &types,
+                  const unordered_map<string, attribute_definition> &attribute_definitions,
+                  const vector<template_file> &templates, const string &output_folder, size_t jobs,
+                  stage_timings &timings)
+{
+    stage_timings::scope print_data_stage(timings, "print_data");
+    // only the parts of the template data which any template uses get built.
+    vector<string> template_texts;
+    for(const template_file &templ : templates)
+    {
+        for(const auto &partial : templ.partials) template_texts.push_back(partial.text);
+        for(const auto &file : templ.files) template_texts.push_back(file.text);
+    }
+    mustache::data template_base_data = print_data(shared_vars, types, attribute_definitions,
+                                                   used_template_keys(template_texts));
+    print_data_stage.stop();
+
+    {
+        stage_timings::scope stage(timings, "render_files");
+        render_files(template_base_data, templates, output_folder, jobs);
+    }
+}
+
+/// A set of templates rendered into one output folder, see the output_group option.
+struct output_group
+{
+    std::string name;
+    vector<string> template_files;
+    string output_folder;
+
+    /// Only what got marked with one of these reflection markers gets rendered.
+    /// Groups without reflection markers of their own get the --reflection_marker ones.
+    vector<string> reflection_markers;
+
+    vector<template_file> templates;
+};
+
+/// Parses e.g. "name=server;output_folder=gen/server;template_file=a.xml,b.xml;reflection_marker=server_mark".
+output_group parse_output_group(const string &spec)
+{
+    output_group group;
+    for(const string &field : split_by_delimiter(spec, ";"))
+    {
+        const size_t separator = field.find('=');
+        if(separator == string::npos) throw po::error("output_group field without '=': " + field);
+        const string key = field.substr(0, separator);
+        const string value = field.substr(separator + 1);
+
+        if(key == "name") group.name = value;
+        else if(key == "output_folder") group.output_folder = value;
+        else if(key == "template_file") group.template_files = split_by_delimiter(value, ",");
+        else if(key == "reflection_marker") group.reflection_markers = split_by_delimiter(value, ",");
+        else throw po::error("unknown output_group field: " + key);
+    }
+    if(group.template_files.empty()) throw po::error("output_group without template_file: " + spec);
+    return group;
+}
+
+/// Whether every variable and class member of the model is marked with one of the markers.
+bool all_marked_with(const vector<SharedVariable> &shared_vars, const type_table &types, const vector<string> &markers)
+{
+    auto is_marked = [&markers](const SharedVariable &var) {
+        return std::find(markers.begin(), markers.end(), var.reflection_marker) != markers.end();
+    };
+    if(!std::all_of(shared_vars.begin(), shared_vars.end(), is_marked)) return false;
+    for(const shared_class_definition &def : types.definitions())
+        if(!std::all_of(def.elements.begin(), def.elements.end(), is_marked)) return false;
+    return true;
+}
+
+/// Renders the templates of every output group with the part of the model marked with the markers of the group.
+/// The AST got loaded with the markers of all groups (or the model file with whatever markers it got emitted with),
+/// so we only skip selecting if the model does not contain anything else.
+void render_groups(const vector<SharedVariable> &shared_vars, type_table &types,
+                   const unordered_map<string, attribute_definition> &attribute_definitions,
+                   const vector<output_group> &groups, size_t jobs, stage_timings &timings)
+{
+    for(const output_group &group : groups)
+    {
+        if(!group.name.empty()) std::cout << "Rendering output group " << group.name << std::endl;
+        if(all_marked_with(shared_vars, types, group.reflection_markers))
+        {
+            render_model(shared_vars, types, attribute_definitions, group.templates, group.output_folder, jobs, timings);
+            continue;
+        }
+        resolved_model selected = select_marked(shared_vars, types, attribute_definitions, group.reflection_markers);
+        render_model(selected.shared_vars, selected.types, selected.attribute_definitions, group.templates,
+                     group.output_folder, jobs, timings);
+    }
+}
+
+/// Resolves the classes of the shared declarations and renders the templates of all groups with them.
+/// @param model_file if not empty, the resolved model gets written to this file as well.
+/// @return the number of shared classes.
+size_t generate_files(ASTs &code, const vector<output_group> &groups, size_t jobs, const string &model_file,
+                      stage_timings &timings)
+{
+    type_table types;
+    {
+        stage_timings::scope stage(timings, "find_class_definitions");
+        class_compound_loader load_compounds;
+        if(code.loads_classes_on_demand())
+            load_compounds = [&code, jobs](const vector<string> &refids) { code.load_class_compounds(refids, jobs); };
+        find_class_definitions(code.class_compounds, code.shared_var_occurences, types, jobs, load_compounds);
+    }
+
+    if(!model_file.empty())
+    {
+        stage_timings::scope stage(timings, "write_model");
+        if(!write_model_file(model_file, code.shared_var_occurences, types, code.attribute_definitions))
+            std::cerr << "Could not write the model file: " << model_file << std::endl;
+    }
+
+    render_groups(code.shared_var_occurences, types, code.attribute_definitions, groups, jobs, timings);
+    return types.definitions().size();
+}
+
 /// Our generation of glue code works in 3 steps:
 ///   1) use doxygen to parse the source and spit out the AST in a XML
 ///   2) use find any Shared Declarations in this AST (parsing the XML)
@@ -41,25 +165,61 @@ int main(int argc, const char **argv)
     // Parse and handle command line arguments
 
     po::variables_map cli_config;
+    vector<output_group> groups;
     po::options_description params("PARAMETERS");
     params.add_options()
         ("help", "Print this help message")
-        ("template_file", po::value<std::vector<std::string>>()->multitoken()->composing()->required(),
+        ("template_file", po::value<std::vector<std::string>>()->multitoken()->composing(),
              "XML file(s) which contain the sections \"partials\" and \"file\" which contain mustache template code.\n"
              "Each entry in there is named.\n"
              "The name of the entry in \"partials\" becomes the name of the partial.\n"
-             "The name of the \"file\" entry becomes the filename of the generated file.")
+             "The name of the \"file\" entry becomes the filename of the generated file.\n"
+             "Either this or output_group is required.")
+        ("output_group", po::value<std::vector<std::string>>()->composing(),
+             "Render another set of templates into another folder in the same run, sharing the loaded AST, e.g.\n"
+             "\"name=server;output_folder=gen/server;template_file=a.xml,b.xml;reflection_marker=server_mark\".\n"
+             "Only the variables (and class members) marked with one of the reflection markers of the group get "
+             "rendered for it, the reflection_marker ones if the group names none.\n"
+             "The partial_files are used by every group. Can be given multiple times.")
         ("partial_file", po::value<std::vector<std::string>>()->multitoken()->composing(),
              "XML file(s) which contains a list with named entries.\n"
              "The name of the entry becomes the name of a partial which will be available in each <template_file>.")
 
-        ("doxygen_AST_folder", po::value<string>()->required(), "The folder containing the doxygen xml (AST) output. \n"
+        ("doxygen_AST_folder", po::value<string>(), "The folder containing the doxygen xml (AST) output (searched recursively). \n"
               "We scan those XML files for Shared Declarations")
+        ("source_folder", po::value<string>(), "Instead of using doxygens AST, scan the C++ files in this folder "
+              "(recursively) for Shared Declarations with our own lightweight declaration scanner.\n"
+              "Either this, doxygen_AST_folder or from_model is required.")
+        ("emit_model", po::value<string>(), "Also write the found variables, their classes and the attributes to this "
+              "binary model file.\n"
+              "Other runs over the same code (e.g. with other templates) can render from it using from_model.")
+        ("from_model", po::value<string>(), "Render the templates from a model file written by emit_model "
+              "(of the same gluegen version) instead of loading the doxygen_AST_folder or source_folder.")
+        ("emit_shard", po::value<string>(), "Only extract the doxygen_AST_folder (or the merged shards) into this shard "
+              "file and exit, without rendering anything.\n"
+              "Several processes can extract parts of the doxygen output this way, a run with merge combines them.")
+        ("merge", po::value<std::vector<std::string>>()->multitoken()->composing(), "Use the shard files written by "
+              "emit_shard instead of the doxygen_AST_folder. The result is the same as for a doxygen_AST_folder "
+              "containing the xml files of all shards.")
         ("output_folder", po::value<string>(), "The folder where all generated files land.\n"
               "If not given, they get placed in the current working dir.")
         ("reflection_marker", po::value<std::vector<std::string>>()->multitoken()->composing()->default_value({"reflection_mark"}, ""),
               "If this search string occurs in the initializer of a variable, it gets marked for reflection.\n"
-              "Multiple reflection markers can be given.");
+              "Multiple reflection markers can be given.")
+        ("jobs", po::value<size_t>()->default_value(1),
+              "The number of threads used for loading the doxygen AST and rendering the files.\n"
+              "0 uses one thread per hardware thread.")
+        ("cache_dir", po::value<string>(), "A folder to cache what got extracted from each doxygen xml file "
+              "and the parsed template files in.\n"
+              "On reruns only the changed xml files get parsed again.")
+        ("timings_file", po::value<string>(), "Write how long each stage of this run took, as json, to this file.\n"
+              "Together with the counts of what got processed it allows comparing runs across gluegen versions.")
+        ("watch", "Do not exit after generating the files, but watch the doxygen_AST_folder (source_folder or from_model) and the "
+              "template and partial files and regenerate on changes.\n"
+              "Only the changed xml files get loaded again and only changed output files get written.")
+        ("trace", po::value<string>(), "Record a trace of this run and write it to this file in the Chrome trace-event format "
+              "(open it in chrome://tracing or Perfetto).\n"
+              "Besides the stages it contains each parsed xml file, each resolved class and each rendered file.");
 
     std::string exec{argv[0]};
 
@@ -77,6 +237,25 @@ int main(int argc, const char **argv)
         }
 
         po::notify(cli_config);
+
+        if(!cli_config.count("doxygen_AST_folder") && !cli_config.count("source_folder") && !cli_config.count("from_model")
+           && !cli_config.count("merge"))
+            throw po::error("either doxygen_AST_folder, source_folder, from_model or merge is required");
+        if(cli_config.count("emit_shard") && (cli_config.count("source_folder") || cli_config.count("from_model")))
+            throw po::error("emit_shard needs the doxygen_AST_folder or shard files to merge");
+
+        if(cli_config.count("template_file"))
+        {
+            output_group group;
+            group.template_files = cli_config["template_file"].as<vector<string>>();
+            if(cli_config.count("output_folder")) group.output_folder = cli_config["output_folder"].as<string>();
+            groups.push_back(std::move(group));
+        }
+        if(cli_config.count("output_group"))
+            for(const string &spec : cli_config["output_group"].as<vector<string>>())
+                groups.push_back(parse_output_group(spec));
+        if(groups.empty() && !cli_config.count("emit_shard"))
+            throw po::error("either template_file or output_group is required");
     } 
     catch(po::error &e) {
         std::cerr << "Failed to parse the main args: " << e.what() << "\n\n";
@@ -84,25 +263,197 @@ int main(int argc, const char **argv)
         return 1;
     }
 
-    const vector<string> template_files = cli_config["template_file"].as<vector<string>>();
     const vector<string> partial_files = cli_config.count("partial_file") ? cli_config["partial_file"].as<vector<string>>() : vector<string>();
-    const string output_folder = cli_config.count("output_folder") ? cli_config["output_folder"].as<string>() : string();
-    const string xml_AST_folder = cli_config["doxygen_AST_folder"].as<string>();
-    reflection_marker_searchstrings = cli_config["reflection_marker"].as<vector<string>>();
+    const string xml_AST_folder = cli_config.count("doxygen_AST_folder") ? cli_config["doxygen_AST_folder"].as<string>() : string();
+    const string source_folder = cli_config.count("source_folder") ? cli_config["source_folder"].as<string>() : string();
+    // the AST gets loaded once for all groups, so with the reflection markers of all of them.
+    vector<string> reflection_markers = cli_config["reflection_marker"].as<vector<string>>();
+    for(output_group &group : groups)
+        if(group.reflection_markers.empty()) group.reflection_markers = reflection_markers;
+    for(const output_group &group : groups)
+        for(const string &marker : group.reflection_markers)
+            if(std::find(reflection_markers.begin(), reflection_markers.end(), marker) == reflection_markers.end())
+                reflection_markers.push_back(marker);
+    set_reflection_markers(reflection_markers);
+    const size_t jobs = cli_config["jobs"].as<size_t>();
+    const string cache_folder = cli_config.count("cache_dir") ? cli_config["cache_dir"].as<string>() : string();
+
+    const string timings_file = cli_config.count("timings_file") ? cli_config["timings_file"].as<string>() : string();
+
+    const string trace_file = cli_config.count("trace") ? cli_config["trace"].as<string>() : string();
+    const string emit_model_file = cli_config.count("emit_model") ? cli_config["emit_model"].as<string>() : string();
+    const string from_model_file = cli_config.count("from_model") ? cli_config["from_model"].as<string>() : string();
+    const string emit_shard_file = cli_config.count("emit_shard") ? cli_config["emit_shard"].as<string>() : string();
+    vector<inexor::filesystem::Path> shard_files;
+    if(cli_config.count("merge"))
+        for(const string &shard : cli_config["merge"].as<vector<string>>()) shard_files.push_back(shard);
+    const bool watch = cli_config.count("watch") != 0;
+    // doxygen rewrites the files we watch in place, a mapped file getting truncated would crash us.
+    inexor::filesystem::mapped_file::read_into_memory = watch;
+
+    stage_timings timings;
+    if(!trace_file.empty()) stage_timings::tracing = &timings;
+    stage_timings::scope total_stage(timings, "total");
 
     ASTs code;
-    code.load_from_directory(xml_AST_folder);
+    code.keep_file_extracts = watch || !emit_shard_file.empty();
+    resolved_model model;
+    if(!from_model_file.empty())
+    {
+        stage_timings::scope stage(timings, "load_model");
+        if(!read_model_file(from_model_file, model))
+        {
+            std::cerr << "Could not read the model file (or it got written by another gluegen version): "
+                      << from_model_file << std::endl;
+            return 1;
+        }
+    }
+    else if(!shard_files.empty())
+    {
+        stage_timings::scope stage(timings, "load_shards");
+        if(!code.load_from_shards(shard_files, reflection_marker_searchstrings)) return 1;
+    }
+    else
+    {
+        stage_timings::scope stage(timings, "load_from_directory");
+        if(!source_folder.empty()) code.load_from_sources(source_folder, jobs, reflection_marker_searchstrings);
+        // watching and sharding need the extracts of all files, otherwise only the needed classes get loaded.
+        else if(watch || !emit_shard_file.empty()
+                || !code.load_from_index(xml_AST_folder, jobs, reflection_marker_searchstrings, cache_folder))
+            code.load_from_directory(xml_AST_folder, jobs, reflection_marker_searchstrings, cache_folder);
+    }
 
-    auto attribute_definitions = parse_shared_attribute_definitions(code.attribute_class_xmls);
+    if(!emit_shard_file.empty())
+    {
+        if(!code.write_shard(emit_shard_file, reflection_marker_searchstrings))
+        {
+            std::cerr << "Could not write the shard file: " << emit_shard_file << std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
-    auto var_occurences = find_shared_var_occurences(code.code_xmls);
+    size_t template_file_count = 0;
+    {
+        stage_timings::scope stage(timings, "load_template_files");
+        for(output_group &group : groups)
+        {
+            group.templates = load_template_files(partial_files, group.template_files, cache_folder);
+            template_file_count += group.templates.size();
+        }
+    }
 
-    unordered_map<string, shared_class_definition> type_definitions;
-    find_class_definitions(code.class_xmls, var_occurences, type_definitions);
+    size_t shared_classes = model.types.definitions().size();
+    try {
+        if(!from_model_file.empty())
+            render_groups(model.shared_vars, model.types, model.attribute_definitions, groups, jobs, timings);
+        else shared_classes = generate_files(code, groups, jobs, emit_model_file, timings);
+    }
+    catch(const shared_class_error &e) {
+        std::cerr << e.what();
+        return 1;
+    }
+    catch(const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+    total_stage.stop();
+
+    const bool from_model = !from_model_file.empty();
+    timings.set_count("shared_variables", from_model ? model.shared_vars.size() : code.shared_var_occurences.size());
+    timings.set_count("class_compounds", code.class_compounds.size());
+    timings.set_count("shared_classes", shared_classes);
+    timings.set_count("attribute_definitions", from_model ? model.attribute_definitions.size()
+                                                          : code.attribute_definitions.size());
+    timings.set_count("template_files", template_file_count);
+    if(!timings_file.empty() && !timings.write_json(timings_file, jobs))
+        std::cerr << "Could not write the timings file: " << timings_file << std::endl;
+    if(!trace_file.empty() && !timings.write_trace(trace_file))
+        std::cerr << "Could not write the trace file: " << trace_file << std::endl;
+    stage_timings::tracing = nullptr;
+
+    if(!watch) return 0;
+
+    // keep everything loaded and only load again what changed.
+    using inexor::filesystem::Path;
+    inexor::filesystem::file_watcher watcher;
+    if(from_model) watcher.add_file(from_model_file);
+    else if(!shard_files.empty())
+    {
+        for(const Path &shard : shard_files) watcher.add_file(shard);
+    }
+    else if(!source_folder.empty()) watcher.add_directory(source_folder, true);
+    else watcher.add_directory(xml_AST_folder, true);
+    for(const output_group &group : groups)
+        for(const string &file : group.template_files) watcher.add_file(file);
+    for(const string &file : partial_files) watcher.add_file(file);
+
+    while(true)
+    {
+        std::cout << "Watching for changes.." << std::endl;
+        const vector<Path> changed_files = watcher.wait_for_changes();
+        const auto start = std::chrono::steady_clock::now();
+
+        // a changed partial file affects all groups, a changed template file only the groups using it.
+        vector<bool> group_changed(groups.size(), false);
+        vector<Path> changed_code_files;
+        for(const Path &file : changed_files)
+        {
+            const bool is_partial = std::find(partial_files.begin(), partial_files.end(), file.string()) != partial_files.end();
+            bool is_template = is_partial;
+            for(size_t i = 0; i < groups.size(); i++)
+            {
+                const vector<string> &template_files = groups[i].template_files;
+                if(is_partial || std::find(template_files.begin(), template_files.end(), file.string()) != template_files.end())
+                {
+                    group_changed[i] = true;
+                    is_template = true;
+                }
+            }
+            if(!is_template) changed_code_files.push_back(file);
+        }
 
-    mustache::data template_base_data = print_data(var_occurences, type_definitions, attribute_definitions);
+        // a broken file (e.g. one doxygen is still writing) must not end the watching.
+        try {
+            for(size_t i = 0; i < groups.size(); i++)
+                if(group_changed[i]) groups[i].templates = load_template_files(partial_files, groups[i].template_files, cache_folder);
+            if(!changed_code_files.empty())
+            {
+                if(from_model)
+                {
+                    if(!read_model_file(from_model_file, model))
+                        std::cerr << "Could not read the model file, keeping the previous one: " << from_model_file << std::endl;
+                }
+                else if(!shard_files.empty()) // merging is cheap, so we merge all of them again.
+                {
+                    ASTs merged_code;
+                    if(merged_code.load_from_shards(shard_files, reflection_marker_searchstrings)) code = std::move(merged_code);
+                    else std::cerr << "Keeping the previously merged shards" << std::endl;
+                }
+                else if(!source_folder.empty()) // the scanned sources are not kept, we scan them all again.
+                {
+                    ASTs scanned_code;
+                    scanned_code.load_from_sources(source_folder, jobs, reflection_marker_searchstrings);
+                    code = std::move(scanned_code);
+                }
+                else code.update_from_directory(xml_AST_folder, changed_code_files, jobs, reflection_marker_searchstrings, cache_folder);
+            }
+
+            stage_timings watch_timings;
+            if(from_model)
+                render_groups(model.shared_vars, model.types, model.attribute_definitions, groups, jobs, watch_timings);
+            else generate_files(code, groups, jobs, emit_model_file, watch_timings);
+        }
+        catch(const std::exception &e) {
+            std::cerr << "ERROR: " << e.what() << std::endl << "Regenerating failed, keeping the previous output" << std::endl;
+            continue;
+        }
 
-    render_files(template_base_data, partial_files, template_files, output_folder);
+        using std::chrono::duration_cast;
+        using std::chrono::milliseconds;
+        std::cout << "Regenerated after " << changed_files.size() << " changed files in "
+                  << duration_cast<milliseconds>(std::chrono::steady_clock::now() - start).count() << "ms" << std::endl;
+    }
 
 
     // Read the list of variables
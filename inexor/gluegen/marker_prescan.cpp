@@ -0,0 +1,147 @@
+
+#include "inexor/gluegen/marker_prescan.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <deque>
+
+using std::string;
+using std::vector;
+
+namespace inexor { namespace gluegen {
+
+/// Returns the longest run of identifier chars ([A-Za-z0-9_]) of the marker.
+/// Only those survive in the raw bytes of the xml file: other chars might end up escaped (e.g. < as &lt;) and doxygen
+/// puts markup around the identifiers it knows (e.g. "NoSync()" becomes "<ref ...>NoSync</ref>()").
+static string longest_identifier_part(const string &marker)
+{
+    string longest, current;
+    for(const char c : marker)
+    {
+        if(!std::isalnum(static_cast<unsigned char>(c)) && c != '_')
+        {
+            current.clear();
+            continue;
+        }
+        current += c;
+        if(current.size() > longest.size()) longest = current;
+    }
+    return longest;
+}
+
+marker_prescanner::marker_prescanner(const vector<string> &markers)
+{
+    enabled = !markers.empty();
+    for(const string &marker : markers)
+    {
+        string needle = longest_identifier_part(marker);
+        if(needle.empty())
+        {
+            enabled = false; // we can not tell anything about files for this marker.
+            return;
+        }
+        if(std::find(first_bytes.begin(), first_bytes.end(), needle[0]) == first_bytes.end())
+            first_bytes.push_back(needle[0]);
+        needles.push_back(std::move(needle));
+    }
+}
+
+bool marker_prescanner::contains_marker(const char *data, size_t size) const
+{
+    if(!enabled) return true;
+
+    // one memchr pass per distinct first byte (usually all markers share it, so it is a single pass).
+    // memchr is vectorized in every libc we care about, it skips most of the file in large strides.
+    const char *end = data + size;
+    for(const char first_byte : first_bytes)
+    {
+        for(const char *candidate = data; candidate < end; candidate++)
+        {
+            candidate = static_cast<const char *>(std::memchr(candidate, first_byte, end - candidate));
+            if(!candidate) break;
+
+            for(const string &needle : needles)
+            {
+                if(needle[0] != first_byte || static_cast<size_t>(end - candidate) < needle.size()) continue;
+                if(std::memcmp(candidate, needle.data(), needle.size()) == 0) return true;
+            }
+        }
+    }
+    return false;
+}
+
+const uint32_t marker_matcher::no_match;
+
+marker_matcher::marker_matcher(const vector<string> &markers)
+    : transitions(1), match_length(1, no_match)
+{
+    // the trie of all markers, missing edges are 0 until the failure links get filled in below.
+    transitions[0].fill(0);
+    for(const string &marker : markers)
+    {
+        if(marker.empty()) continue;
+        uint32_t node = 0;
+        for(const char c : marker)
+        {
+            uint32_t &next = transitions[node][static_cast<unsigned char>(c)];
+            if(next == 0)
+            {
+                next = static_cast<uint32_t>(transitions.size());
+                transitions.emplace_back();
+                transitions.back().fill(0);
+                match_length.push_back(no_match);
+            }
+            node = next;
+        }
+        match_length[node] = static_cast<uint32_t>(marker.size());
+    }
+
+    // breadth first, every missing edge gets the edge of the failure state (the longest proper suffix in the trie).
+    std::vector<uint32_t> failure(transitions.size(), 0);
+    std::deque<uint32_t> queue;
+    for(const uint32_t child : transitions[0])
+        if(child != 0) queue.push_back(child);
+    while(!queue.empty())
+    {
+        const uint32_t node = queue.front();
+        queue.pop_front();
+        if(match_length[node] == no_match) match_length[node] = match_length[failure[node]];
+        for(size_t c = 0; c < 256; c++)
+        {
+            uint32_t &next = transitions[node][c];
+            if(next == 0)
+            {
+                next = transitions[failure[node]][c];
+                continue;
+            }
+            failure[next] = transitions[failure[node]][c];
+            queue.push_back(next);
+        }
+    }
+}
+
+bool marker_matcher::feed(state &s, const char *data, size_t size, size_t &match_position) const
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        s.node = transitions[s.node][static_cast<unsigned char>(data[i])];
+        if(match_length[s.node] != no_match)
+        {
+            match_position = s.offset + i + 1 - match_length[s.node];
+            s.offset += i + 1;
+            return true;
+        }
+    }
+    s.offset += size;
+    return false;
+}
+
+size_t marker_matcher::find(const string &text) const
+{
+    state s;
+    size_t position;
+    return feed(s, text.data(), text.size(), position) ? position : string::npos;
+}
+
+} } // namespace inexor::gluegen
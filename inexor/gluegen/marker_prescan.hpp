@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <string>
+
+namespace inexor { namespace gluegen {
+
+/// Searches the raw bytes of a (xml) file for reflection markers, without parsing it.
+///
+/// This is used to skip building a DOM for AST files which can not contain any marked variable.
+/// It only gives a necessary condition: a hit does not mean the file contains a marked variable, but no hit means it
+/// does not.
+class marker_prescanner
+{
+    /// What we actually search for: the longest run of identifier chars of each marker, see longest_identifier_part.
+    std::vector<std::string> needles;
+
+    /// The distinct first bytes of all needles, each needle gets tested only where its first byte occurs.
+    std::vector<char> first_bytes;
+
+    /// If false, every file counts as containing a marker (no markers given, or one without any identifier char).
+    bool enabled = false;
+
+public:
+    explicit marker_prescanner(const std::vector<std::string> &markers);
+
+    /// Whether we will ever report a file as not containing a marker.
+    bool is_enabled() const { return enabled; }
+
+    /// Returns true if any of the markers (possibly) occurs in the given bytes.
+    bool contains_marker(const char *data, size_t size) const;
+};
+
+/// Finds the first of several markers in a text with an Aho-Corasick automaton, in one pass without allocating.
+///
+/// The text can be fed in pieces (e.g. the text nodes of a xml element), markers spanning two pieces get found as well.
+/// Empty markers are ignored.
+class marker_matcher
+{
+    /// The automaton: for every state the state after each byte, state 0 is the start.
+    std::vector<std::array<uint32_t, 256>> transitions;
+
+    /// For every state the length of the longest marker ending there or no_match.
+    std::vector<uint32_t> match_length;
+
+    static const uint32_t no_match = uint32_t(-1);
+
+public:
+    explicit marker_matcher(const std::vector<std::string> &markers);
+
+    /// The progress of a search, carried from piece to piece.
+    struct state
+    {
+        uint32_t node = 0;
+
+        /// The number of bytes fed so far.
+        size_t offset = 0;
+    };
+
+    /// Feeds the next piece of the text.
+    /// @param match_position gets the position of the marker in the complete text if one got found.
+    /// @return true if a marker ended in this piece.
+    bool feed(state &s, const char *data, size_t size, size_t &match_position) const;
+
+    /// Returns the position of the first marker in the text or std::string::npos.
+    size_t find(const std::string &text) const;
+};
+
+} } // namespace inexor::gluegen
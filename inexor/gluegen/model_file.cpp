@@ -0,0 +1,139 @@
+
+#include "inexor/gluegen/model_file.hpp"
+#include "inexor/gluegen/extraction_cache.hpp"
+#include "inexor/gluegen/binary_records.hpp"
+
+#include <set>
+#include <unordered_set>
+
+using std::string;
+using std::vector;
+using std::unordered_map;
+using namespace inexor::filesystem;
+
+namespace inexor { namespace gluegen {
+
+/// Increase this whenever the layout of the model file changes.
+static const uint32_t model_format_version = 2;
+static const char model_magic[4] = {'I', 'G', 'G', 'M'};
+
+/// Adds the definition of the type (after the ones of its selected elements) to the selected model.
+void select_definition(type_id type, type_table &types, const std::set<string> &markers,
+                       std::unordered_set<const shared_class_definition *> &selected, resolved_model &model)
+{
+    const shared_class_definition *def = types.find_definition(type);
+    if(!def || !selected.insert(def).second) return;
+
+    shared_class_definition selected_def;
+    selected_def.class_name = def->class_name;
+    selected_def.refid = def->refid;
+    selected_def.definition_namespace = def->definition_namespace;
+    selected_def.definition_header = def->definition_header;
+    for(const SharedVariable &element : def->elements)
+    {
+        if(!markers.count(element.reflection_marker)) continue;
+        selected_def.elements.push_back(element);
+        select_definition(types.intern(element.type), types, markers, selected, model);
+    }
+    selected_def.type = model.types.intern(types.node(type));
+    const type_id selected_type = selected_def.type;
+    model.types.add_definition(selected_type, std::move(selected_def));
+}
+
+resolved_model select_marked(const vector<SharedVariable> &shared_vars, type_table &types,
+                             const unordered_map<string, attribute_definition> &attribute_definitions,
+                             const vector<string> &reflection_markers)
+{
+    const std::set<string> markers(reflection_markers.begin(), reflection_markers.end());
+    std::unordered_set<const shared_class_definition *> selected;
+
+    resolved_model model;
+    model.attribute_definitions = attribute_definitions;
+    for(const SharedVariable &var : shared_vars)
+    {
+        if(!markers.count(var.reflection_marker)) continue;
+        model.shared_vars.push_back(var);
+        select_definition(types.intern(var.type), types, markers, selected, model);
+    }
+    return model;
+}
+
+/// Writes an interned type in the layout of write_type_node.
+void write_interned_type(record_writer &out, const type_table &types, type_id type)
+{
+    out.write_string(types[type].refid);
+    out.write_string(types[type].pure_type);
+    out.write_u32(static_cast<uint32_t>(types[type].template_types.size()));
+    for(const type_id template_type : types[type].template_types)
+        write_interned_type(out, types, template_type);
+}
+
+bool write_model_file(const Path &file, const vector<SharedVariable> &shared_vars, const type_table &types,
+                      const unordered_map<string, attribute_definition> &attribute_definitions)
+{
+    record_writer out;
+    out.write_header(model_magic, model_format_version);
+    out.write_string(gluegen_version);
+
+    write_shared_vars(out, shared_vars);
+
+    // in the order they got resolved, the templates list them in that order.
+    out.write_u32(static_cast<uint32_t>(types.definitions().size()));
+    for(const shared_class_definition &def : types.definitions())
+    {
+        write_interned_type(out, types, def.type);
+        out.write_string(def.class_name);
+        out.write_string(def.refid);
+        out.write_strings(def.definition_namespace);
+        out.write_string(def.definition_header);
+        write_shared_vars(out, def.elements);
+    }
+
+    out.write_u32(static_cast<uint32_t>(attribute_definitions.size()));
+    for(const attribute_definition *def : sorted_attribute_definitions(attribute_definitions))
+        write_attribute(out, *def);
+
+    return write_file_atomically(file, out.buffer.data(), out.buffer.size());
+}
+
+bool read_model_file(const Path &file, resolved_model &model)
+{
+    mapped_file mapped(file);
+    if(!mapped.is_open()) return false;
+
+    record_reader in(mapped.data(), mapped.size());
+    if(!in.read_header(model_magic, model_format_version) || in.read_string() != gluegen_version) return false;
+
+    resolved_model loaded;
+    read_shared_vars(in, loaded.shared_vars);
+
+    for(uint32_t i = 0, count = in.read_u32(); in.ok && i < count; i++)
+    {
+        SharedVariable::type_node_t type;
+        read_type_node(in, type);
+
+        shared_class_definition def;
+        def.type = loaded.types.intern(type);
+        def.class_name = in.read_string();
+        def.refid = in.read_string();
+        def.definition_namespace = in.read_strings();
+        def.definition_header = in.read_string();
+        read_shared_vars(in, def.elements);
+        const type_id def_type = def.type;
+        loaded.types.add_definition(def_type, std::move(def));
+    }
+
+    for(uint32_t i = 0, count = in.read_u32(); in.ok && i < count; i++)
+    {
+        attribute_definition attribute;
+        read_attribute(in, attribute);
+        const string name = attribute.name;
+        loaded.attribute_definitions.emplace(name, std::move(attribute));
+    }
+    if(!in.done()) return false;
+
+    model = std::move(loaded);
+    return true;
+}
+
+} } // namespace inexor::gluegen
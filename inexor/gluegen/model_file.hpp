@@ -0,0 +1,46 @@
+#pragma once
+
+#include "inexor/filesystem/path.hpp"
+#include "inexor/gluegen/SharedVariables.hpp"
+#include "inexor/gluegen/SharedVarDatatypes.hpp"
+#include "inexor/gluegen/SharedAttributes.hpp"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace inexor { namespace gluegen {
+
+/// Everything the templates get rendered from: the marked variables with their resolved classes and the attributes.
+struct resolved_model
+{
+    std::vector<SharedVariable> shared_vars;
+
+    /// The types with the shared class definitions (see find_class_definitions).
+    type_table types;
+
+    /// Key is the name of the attribute.
+    std::unordered_map<std::string, attribute_definition> attribute_definitions;
+};
+
+/// The part of the model marked with one of the given reflection markers: the variables and class members marked with
+/// one of them and the shared class definitions those need, in the same order.
+/// @param types gets used to look up the definitions, the new model has its own.
+extern resolved_model select_marked(const std::vector<SharedVariable> &shared_vars, type_table &types,
+                                    const std::unordered_map<std::string, attribute_definition> &attribute_definitions,
+                                    const std::vector<std::string> &reflection_markers);
+
+/// Writes the model to a binary file, so other runs over the same code can render from it without loading the ASTs.
+///
+/// The file starts with a format version and the gluegen version, it is only read back by the same gluegen version.
+/// @note It is written in host byte order, the model file is not meant to be shared between machines.
+/// @return false if the file could not be written.
+extern bool write_model_file(const inexor::filesystem::Path &file, const std::vector<SharedVariable> &shared_vars,
+                             const type_table &types,
+                             const std::unordered_map<std::string, attribute_definition> &attribute_definitions);
+
+/// Maps a file written by write_model_file and restores the model from it.
+/// @return false if the file could not be read, is corrupt or got written by another gluegen version.
+extern bool read_model_file(const inexor::filesystem::Path &file, resolved_model &model);
+
+} } // namespace inexor::gluegen
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace inexor { namespace gluegen {
+
+/// Returns the number of worker threads to use for a requested amount of jobs.
+/// 0 means "one per hardware thread".
+inline size_t resolve_jobs(size_t jobs)
+{
+    if(jobs != 0) return jobs;
+    const size_t hardware_threads = std::thread::hardware_concurrency();
+    return hardware_threads ? hardware_threads : 1;
+}
+
+/// Calls func(i) for every i in [0, count) using up to jobs threads.
+///
+/// Indices get handed out one by one, so uneven work items do not stall a whole thread.
+/// func needs to be safe to be executed concurrently for different indices, the usual pattern is to let every
+/// index write into its own preallocated output slot and merge those afterwards.
+/// With jobs == 1 (or a single work item) everything runs in order on the calling thread.
+/// The first exception thrown inside func gets rethrown on the calling thread after all workers stopped.
+template<typename Func>
+void parallel_for(size_t count, size_t jobs, Func func)
+{
+    const size_t thread_count = std::min(resolve_jobs(jobs), count);
+    if(thread_count <= 1)
+    {
+        for(size_t i = 0; i < count; i++)
+            func(i);
+        return;
+    }
+
+    std::atomic<size_t> next_index{0};
+    std::exception_ptr first_exception;
+    std::mutex exception_mutex;
+
+    auto worker = [&]() {
+        for(size_t i = next_index++; i < count; i = next_index++)
+        {
+            try {
+                func(i);
+            }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(exception_mutex);
+                if(!first_exception) first_exception = std::current_exception();
+                next_index = count; // let the others finish early.
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(size_t t = 1; t < thread_count; t++)
+        threads.emplace_back(worker);
+    worker(); // the calling thread is a worker as well.
+    for(auto &thread : threads)
+        thread.join();
+
+    if(first_exception)
+        std::rethrow_exception(first_exception);
+}
+
+} } // namespace inexor::gluegen
@@ -1,9 +1,9 @@
 #include <pugiconfig.hpp>
 #include <pugixml.hpp>
 
-#include <boost/algorithm/string/replace.hpp>
-
 #include <cctype>
+#include <cstdint>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <algorithm>
@@ -14,21 +14,255 @@ using namespace std;
 
 namespace inexor { namespace gluegen {
 
-string unescape(string &str)
+namespace {
+
+/// Lookup tables for the literal lexer, indexed by the (unsigned) char.
+struct literal_tables
+{
+    /// The char a simple escape sequence stands for (the char behind the backslash), 0 if its no simple escape.
+    char escape[256];
+    /// The value of a (hex) digit, -1 if its no digit.
+    signed char digit[256];
+
+    literal_tables()
+    {
+        for(int i = 0; i < 256; i++)
+        {
+            escape[i] = 0;
+            digit[i] = -1;
+        }
+        const char *from = "'\"?\\abfnrtv";
+        const char *to = "'\"?\\\a\b\f\n\r\t\v";
+        for(int i = 0; from[i]; i++) escape[static_cast<unsigned char>(from[i])] = to[i];
+        for(int i = 0; i < 10; i++) digit['0'+i] = i;
+        for(int i = 0; i < 6; i++) digit['a'+i] = digit['A'+i] = 10+i;
+    }
+};
+
+/// Built before main, a function local static would not be thread safe (we build with -fno-threadsafe-statics)
+/// and the lexer runs on the worker threads of ASTs::load_files.
+const literal_tables tables;
+
+inline int digit_value(char c, int base)
+{
+    const int v = tables.digit[static_cast<unsigned char>(c)];
+    return v < base ? v : -1;
+}
+
+void append_utf8(string &out, uint32_t codepoint)
+{
+    if(codepoint < 0x80) out += static_cast<char>(codepoint);
+    else if(codepoint < 0x800)
+    {
+        out += static_cast<char>(0xC0 | (codepoint >> 6));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    else if(codepoint < 0x10000)
+    {
+        out += static_cast<char>(0xE0 | (codepoint >> 12));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+    else
+    {
+        out += static_cast<char>(0xF0 | (codepoint >> 18));
+        out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+}
+
+/// Lexes one (possibly prefixed) string literal starting at pos and appends its unescaped content to out.
+/// @return false if there is no complete string literal at pos.
+bool lex_string_literal(const string &in, size_t &pos, string &out)
+{
+    const size_t len = in.size();
+    size_t i = pos;
+    // encoding prefixes: u8, u, U, L
+    if(i < len && (in[i] == 'u' || in[i] == 'U' || in[i] == 'L'))
+    {
+        if(in[i] == 'u' && i+1 < len && in[i+1] == '8') i++;
+        i++;
+    }
+    const bool raw = i < len && in[i] == 'R';
+    if(raw) i++;
+    if(i >= len || in[i] != '"') return false;
+    i++;
+
+    if(raw) // R"delim( ... )delim"
+    {
+        const size_t open = in.find('(', i);
+        if(open == string::npos) return false;
+        const string terminator = ")" + in.substr(i, open-i) + "\"";
+        const size_t close = in.find(terminator, open+1);
+        if(close == string::npos) return false;
+        out.append(in, open+1, close-open-1);
+        pos = close + terminator.size();
+        return true;
+    }
+
+    while(i < len && in[i] != '"')
+    {
+        if(in[i] != '\\')
+        {
+            // copy the run up to the next special char at once.
+            size_t run_end = i;
+            while(run_end < len && in[run_end] != '"' && in[run_end] != '\\') run_end++;
+            out.append(in, i, run_end-i);
+            i = run_end;
+            continue;
+        }
+        if(++i >= len) return false;
+        const char c = in[i];
+        if(const char simple = tables.escape[static_cast<unsigned char>(c)])
+        {
+            out += simple;
+            i++;
+        }
+        else if(digit_value(c, 8) >= 0) // \ooo, at most 3 digits
+        {
+            unsigned value = 0;
+            for(int n = 0; n < 3 && i < len && digit_value(in[i], 8) >= 0; n++, i++) value = value*8 + digit_value(in[i], 8);
+            out += static_cast<char>(value);
+        }
+        else if(c == 'x') // \xhh...
+        {
+            unsigned value = 0;
+            size_t start = ++i;
+            for(; i < len && digit_value(in[i], 16) >= 0; i++) value = value*16 + digit_value(in[i], 16);
+            if(i == start) return false;
+            out += static_cast<char>(value);
+        }
+        else if(c == 'u' || c == 'U') // \uXXXX, \UXXXXXXXX
+        {
+            const int digits = c == 'u' ? 4 : 8;
+            uint32_t codepoint = 0;
+            i++;
+            for(int n = 0; n < digits; n++, i++)
+            {
+                if(i >= len || digit_value(in[i], 16) < 0) return false;
+                codepoint = codepoint*16 + digit_value(in[i], 16);
+            }
+            append_utf8(out, codepoint);
+        }
+        else return false;
+    }
+    if(i >= len) return false;
+    pos = i+1;
+    return true;
+}
+
+/// Normalizes a number literal, see normalize_literal.
+/// @return false if the input is no number literal we know how to handle.
+bool lex_number_literal(const string &in, string &out)
 {
-    using boost::algorithm::replace_all;
-    replace_all(str, "\\'", "\'"); // This is of course non-optimized since we have many roundtrips instead of just one.
-    replace_all(str, "\\\"", "\"");
-    replace_all(str, "\\?", "\?");
-    replace_all(str, "\\\\", "\\");
-    replace_all(str, "\\a", "\a");
-    replace_all(str, "\\b", "\b");
-    replace_all(str, "\\f", "\f");
-    replace_all(str, "\\n", "\n");
-    replace_all(str, "\\r", "\r");
-    replace_all(str, "\\t", "\t");
-    replace_all(str, "\\v", "\v");
-    return str;
+    const size_t len = in.size();
+    size_t i = 0;
+    string sign;
+    if(in[i] == '-' || in[i] == '+')
+    {
+        if(in[i] == '-') sign = "-";
+        i++;
+    }
+    if(i >= len) return false;
+
+    int base = 10;
+    if(in[i] == '0' && i+1 < len)
+    {
+        const char c = in[i+1];
+        if(c == 'x' || c == 'X') base = 16;
+        else if(c == 'b' || c == 'B') base = 2;
+        else if(digit_value(c, 10) >= 0 || c == '\'') base = 8;
+        if(base == 16 || base == 2) i += 2;
+    }
+
+    if(base == 10 || base == 8)
+    {
+        // decimal digits, a fraction or an exponent make it a floating point literal (octal ones only for integers).
+        string body;
+        bool is_float = false;
+        bool seen_digit = false;
+        for(; i < len; i++)
+        {
+            const char c = in[i];
+            if(c == '\'') continue;
+            if(digit_value(c, 10) >= 0) seen_digit = true;
+            else if(c == '.') is_float = true;
+            else if(c == 'e' || c == 'E')
+            {
+                is_float = true;
+                body += c;
+                if(i+1 < len && (in[i+1] == '+' || in[i+1] == '-')) body += in[++i];
+                continue;
+            }
+            else break;
+            body += c;
+        }
+        if(!seen_digit) return false;
+        const char *allowed_suffixes = is_float ? "fFlL" : "uUlL";
+        for(; i < len; i++) if(!strchr(allowed_suffixes, in[i])) return false;
+
+        if(is_float || base == 10)
+        {
+            out = sign + body;
+            return true;
+        }
+        // octal: reparse the collected digits below.
+        uint64_t value = 0;
+        for(const char c : body)
+        {
+            const int d = digit_value(c, 8);
+            if(d < 0 || value > (UINT64_MAX >> 3)) return false;
+            value = value*8 + d;
+        }
+        out = sign + to_string(value);
+        return true;
+    }
+
+    uint64_t value = 0;
+    bool seen_digit = false;
+    const int shift = base == 16 ? 4 : 1;
+    for(; i < len; i++)
+    {
+        const char c = in[i];
+        if(c == '\'') continue;
+        const int d = digit_value(c, base);
+        if(d < 0) break;
+        if(value > (UINT64_MAX >> shift)) return false;
+        value = (value << shift) | d;
+        seen_digit = true;
+    }
+    if(!seen_digit) return false;
+    for(; i < len; i++) if(!strchr("uUlL", in[i])) return false; // hex floats end up here as well.
+    out = sign + to_string(value);
+    return true;
+}
+
+} // namespace
+
+string normalize_literal(const string &literal)
+{
+    size_t begin = 0, end = literal.size();
+    while(begin < end && isspace(static_cast<unsigned char>(literal[begin]))) begin++;
+    while(end > begin && isspace(static_cast<unsigned char>(literal[end-1]))) end--;
+    const string trimmed = literal.substr(begin, end-begin);
+    if(trimmed.empty()) return trimmed;
+
+    string out;
+    // a sequence of string literals separated by whitespace gets concatenated.
+    size_t pos = 0;
+    bool is_string = false;
+    while(lex_string_literal(trimmed, pos, out))
+    {
+        is_string = true;
+        while(pos < trimmed.size() && isspace(static_cast<unsigned char>(trimmed[pos]))) pos++;
+        if(pos == trimmed.size()) return out;
+    }
+    if(is_string) return trimmed; // something else follows the strings, i.e. an expression.
+
+    out.clear();
+    if(lex_number_literal(trimmed, out)) return out;
+    return trimmed;
 }
 
 // Move to utils
@@ -93,12 +327,6 @@ vector<string> split_in_alphanumeric_parts(const string input, bool respect_quot
     return std::move(out);
 }
 
-void trim_floating_point_number_mark(string &str)
-{
-    int strlen = str.length();
-    if(strlen>=2 && str[strlen-1]=='f' && (std::isdigit(str[strlen-2])||str[strlen-2]=='.')) str.pop_back();
-}
-
 void remove_leading_assign_sign(string &str)
 {
     if(str.empty()) return;
@@ -8,15 +8,13 @@
 namespace inexor { namespace gluegen {
 
 
-/// Replaces input containing escaped chars with their string representation (e.g. "\\n" with the newline character)
-/// Currently it supports: \' \" \? \\ \a \b \f \n \r \t \v . Search for Escape codes c++ to get their specific meaning.
-extern std::string unescape(std::string &str);
-
-/// Remove the last second last char is a digit (or a dot) and the last one is a 'f'.
+/// Normalizes a C++ literal in a single pass, so it can be used as value in the templates (e.g. for protobuf).
 ///
-/// This function removes the 'f' from a string like "0.0f", so it works in protobuf where you don't write floats this way.
-/// Only if the first char is a floating point number otherwise the string stays unaltered.
-extern void trim_floating_point_number_mark(std::string &str);
+/// String literals lose their quotes and prefixes, adjacent ones get concatenated ("a" "b" -> ab) and escape sequences
+/// get replaced (simple, octal, hex and universal character names, the latter as UTF-8). Raw strings stay verbatim.
+/// Integer literals get converted to decimal (0x1F, 017, 0b11), digit separators and u/l/f suffixes get removed.
+/// Surrounding whitespace gets trimmed, anything else (char literals, expressions, ...) is returned unaltered.
+extern std::string normalize_literal(const std::string &literal);
 
 /// This function workarounds doxygens faulty xml which contains '= whateverisbehind' as initializer (totally raw, no c++11 support it seems)
 extern void remove_leading_assign_sign(std::string &str);
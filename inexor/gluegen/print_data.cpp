@@ -3,6 +3,7 @@
 #include "inexor/gluegen/SharedVarDatatypes.hpp"
 #include "inexor/gluegen/SharedAttributes.hpp"
 #include "inexor/gluegen/parse_helpers.hpp"
+#include "inexor/gluegen/template_keys.hpp"
 #include "inexor/filesystem/path.hpp"
 
 #include <pugiconfig.hpp>
@@ -13,7 +14,7 @@
 #include <boost/algorithm/string.hpp>
 
 #include <fstream>
-#include <set>
+#include <memory>
 
 using namespace pugi;
 using namespace kainjow;
@@ -77,17 +78,16 @@ const TYPE get_type_of_literal(const string &literal)
     return TYPE_INT;
 }
 
-bool is_compatible_constructor(const vector<string> &given_arguments,
+bool is_compatible_constructor(const vector<TYPE> &given_types,
                                const attribute_definition::constructor &constr_definition)
 {
     int i;
-    for(i = 0; i < given_arguments.size(); i++)
+    for(i = 0; i < given_types.size(); i++)
     {
         if(i >= constr_definition.constructor_args.size()) return false;
 
-        const function_parameter def_arg = constr_definition.constructor_args[i];
-        TYPE t = get_type_of_literal(given_arguments[i]);
-        if(!is_compatible_type(t, def_arg.type)) return false;
+        const function_parameter &def_arg = constr_definition.constructor_args[i];
+        if(!is_compatible_type(given_types[i], def_arg.type)) return false;
     }
     // if all arguments until here are compatible, we still didn't handle the case
     // that we did not pass all arguments, but only a subset.
@@ -99,37 +99,71 @@ bool is_compatible_constructor(const vector<string> &given_arguments,
     return true;
 }
 
-/// Returns that operator of the list of overloaded operators, which corresponds to the list of given arguments.
-const attribute_definition::constructor
-    find_constructor_by_typelist(const vector<string> &given_arguments,
-                                 const vector<attribute_definition::constructor> &possible_constructors)
+/// Returns the index of that operator of the list of overloaded operators, which corresponds to the list of given
+/// argument types.
+size_t find_constructor_by_typelist(const vector<TYPE> &given_types,
+                                    const vector<attribute_definition::constructor> &possible_constructors)
 {
-    for(const attribute_definition::constructor &con : possible_constructors)
+    for(size_t i = 0; i < possible_constructors.size(); i++)
     {
-        if (is_compatible_constructor(given_arguments, con))
-            return con;
+        if (is_compatible_constructor(given_types, possible_constructors[i]))
+            return i;
     }
     throw std::logic_error("No fitting constructor found");
 }
 
-/// This removes whitespace, trim any surrounding whitespace, in the future also convert literals (i.e hex -> decimal)
-string convert_literal_to_protobuf_comatible_literal(const string &mangled_literal)
+/// The attribute definitions prepared for adding them to the templatedata of every variable.
+///
+/// The default values of the constructor arguments are compiled once, the ones without any mustache tag are no
+/// templates at all. The constructor fitting the types of the given arguments only gets searched once per attribute
+/// and list of argument types.
+class attribute_resolver
 {
-    string out = mangled_literal;
-    trim(out);
-    remove_surrounding_quotes(out);
-    return out;
-}
+    struct prepared_attribute
+    {
+        const attribute_definition *def;
+
+        /// For every constructor and argument the compiled default value or nullptr if it is the same for every variable.
+        vector<vector<unique_ptr<mustache::mustache>>> default_value_templates;
+
+        /// Key is the types of the given arguments, one char each. Value is the index of the constructor.
+        unordered_map<string, size_t> constructor_by_signature;
+    };
 
-/// Add templatedata for this shared variable coming from attributes.
-/// Attached atributes are technically class instances.
-/// If a defined attribute has default values, the attribute should be added to each variable
-/// not having the attribute attached.
-/// Also the default value gets used when the attached attribute does pass all possible constructor parameters
-/// (so the remaining have the default value set)
-void add_attached_attributes_templatedata(mustache::data &variable_data,
-                                 const unordered_map<string, SharedVariable::attached_attribute> attached_attributes,
-                                 const unordered_map<string, attribute_definition> &attribute_definitions)
+    /// In the order of the attribute definitions.
+    vector<prepared_attribute> attributes;
+
+  public:
+    explicit attribute_resolver(const unordered_map<string, attribute_definition> &attribute_definitions)
+    {
+        for(const attribute_definition *def : sorted_attribute_definitions(attribute_definitions))
+        {
+            prepared_attribute attribute;
+            attribute.def = def;
+            for(const auto &constructor : def->constructors)
+            {
+                attribute.default_value_templates.emplace_back();
+                for(const function_parameter &arg : constructor.constructor_args)
+                    attribute.default_value_templates.back().emplace_back(
+                            arg.default_value.find("{{") == string::npos
+                                ? nullptr : new mustache::mustache(arg.default_value));
+            }
+            attributes.push_back(std::move(attribute));
+        }
+    }
+
+    /// Add templatedata for this shared variable coming from attributes.
+    /// Attached atributes are technically class instances.
+    /// If a defined attribute has default values, the attribute should be added to each variable
+    /// not having the attribute attached.
+    /// Also the default value gets used when the attached attribute does pass all possible constructor parameters
+    /// (so the remaining have the default value set)
+    void add_attached_attributes_templatedata(mustache::data &variable_data,
+                                              const unordered_map<string, SharedVariable::attached_attribute> &attached_attributes);
+};
+
+void attribute_resolver::add_attached_attributes_templatedata(mustache::data &variable_data,
+                                 const unordered_map<string, SharedVariable::attached_attribute> &attached_attributes)
 {
     /*
      * Flow:
@@ -156,51 +190,48 @@ void add_attached_attributes_templatedata(mustache::data &variable_data,
 
     // add template data from constructor arguments:
     mustache::data attached_attributes_data{mustache::data::type::list};
-    for(auto &deftupel : attribute_definitions)
+    const vector<string> no_arguments;
+    for(prepared_attribute &attribute : attributes)
     {
-        auto &def = deftupel.second;
+        const attribute_definition &def = *attribute.def;
         mustache::data constructor_args_data{mustache::data::type::list};
 
         // This defined attribute was found in the list of attached attributes
-        bool attribute_is_attached;
         auto attached_attr_iter = attached_attributes.find(def.name);
-        if(attached_attr_iter != attached_attributes.end())
-            attribute_is_attached = true;
-        else
-            attribute_is_attached = false;
+        const vector<string> &given_arguments = attached_attr_iter != attached_attributes.end()
+                                                ? attached_attr_iter->second.constructor_args : no_arguments;
 
-        const auto constructor = find_constructor_by_typelist(attribute_is_attached
-                                     ? attached_attr_iter->second.constructor_args
-                                     : vector<string>(),
-                                    def.constructors);
+        vector<TYPE> given_types;
+        string signature;
+        for(const string &arg : given_arguments)
+        {
+            given_types.push_back(get_type_of_literal(arg));
+            signature += static_cast<char>('0' + given_types.back());
+        }
+        auto resolved = attribute.constructor_by_signature.find(signature);
+        if(resolved == attribute.constructor_by_signature.end())
+            resolved = attribute.constructor_by_signature.emplace(signature,
+                           find_constructor_by_typelist(given_types, def.constructors)).first;
+        const auto &constructor = def.constructors[resolved->second];
+        const auto &default_value_templates = attribute.default_value_templates[resolved->second];
 
         for(size_t i = 0; i < constructor.constructor_args.size(); i++)
         {
             const function_parameter &def_construct_param = constructor.constructor_args[i];
-            const string param_name = def_construct_param.name;
-
 
             mustache::data arg_data{mustache::data::type::object};
-            arg_data.set("attr_arg_name", param_name);
+            arg_data.set("attr_arg_name", def_construct_param.name);
             string param_value;
 
-            string given_argument = attribute_is_attached ?
-                                    (attached_attr_iter->second.constructor_args.size() > i ?
-                                        attached_attr_iter->second.constructor_args[i]
-                                     : "")
-                                    : "";
+            const string given_argument = given_arguments.size() > i ? given_arguments[i] : "";
 
             if (given_argument.empty()) {
                 // use default value.
-
-             //   if (def_construct_param.default_value.empty())
-             //       continue;
-                const string param_value_template = def_construct_param.default_value;
-                mustache::mustache tmpl{param_value_template};
-                param_value = tmpl.render(variable_data);
+                if(default_value_templates[i]) param_value = default_value_templates[i]->render(variable_data);
+                else param_value = def_construct_param.default_value;
             }
             else {
-                param_value = convert_literal_to_protobuf_comatible_literal(given_argument);
+                param_value = normalize_literal(given_argument);
             }
 
             arg_data.set("attr_arg_value", param_value);
@@ -226,81 +257,101 @@ string make_pure_type_printable(const string &pure_type)
     return std::move(t);
 }
 
-/// Print a type with template arguments from a type_node_t.
+/// Print a type with its template arguments.
 /// Output e.g. "sharedvar<int, int>"
 /// or "sharedvar-int_int-" when non-default separators are given.
-const string print_full_type(const SharedVariable::type_node_t &type,
-                            const unordered_map<string, shared_class_definition> &type_definitions,
-                            const string template_open = "<",
-                            const string template_seperator = ", ",
-                            const string template_close = ">",
-                            bool make_printable = false)
+const string print_full_type(type_id type,
+                             const type_table &types,
+                             const string template_open = "<",
+                             const string template_seperator = ", ",
+                             const string template_close = ">",
+                             bool make_printable = false)
 {
     std::string buf;
 
     // either add the class name (if we can resolve it) or the class_name
-    if (type_definitions.count(type.uniqueID()))
+    const shared_class_definition *def = types.find_definition(type);
+    if (def)
     {
-        buf = type_definitions.find(type.uniqueID())->second.class_name;
+        buf = def->class_name;
     } else {
-        buf = make_printable ? make_pure_type_printable(type.pure_type) : type.pure_type;
+        buf = make_printable ? make_pure_type_printable(types[type].pure_type) : types[type].pure_type;
     }
 
-    for (size_t i = 0; i < type.template_types.size(); i++)
+    const vector<type_id> &template_types = types[type].template_types;
+    for (size_t i = 0; i < template_types.size(); i++)
     {
         if (i == 0) buf += template_open;
-        buf += print_full_type(type.template_types[i], type_definitions,
+        buf += print_full_type(template_types[i], types,
                                template_open, template_seperator, template_close, make_printable);
-        if (i==type.template_types.size()-1) buf += template_close;
+        if (i==template_types.size()-1) buf += template_close;
         else buf += template_seperator;
     }
     return buf;
 }
 
+/// The name of the type in its "is_<type>" entry.
+string get_is_type_ident(type_id type, const type_table &types)
+{
+    if(const shared_class_definition *classdef = types.find_definition(type))
+        return classdef->class_name;
+    // its not a class, which was found, but either an unresolved class type (without refid) or a builtin type
+    // (int, float..)
+    return make_pure_type_printable(types[type].pure_type);
+}
+
 /// Each variable's templatedata has a "is_typeint" entry.
-/// Since member variables should not have the parents entry, we need to collect all previous definitions and null them
-/// explicitely.
-void add_is_type_member(const SharedVariable::type_node_t &type_node,
-                        const unordered_map<string, shared_class_definition> &type_definitions,
+/// Mustache looks up missing entries in the enclosing data (e.g. a member in its class), so we only need to null the
+/// entries of the enclosing types explicitly. Every other "is_<type>" is missing and hence false as well.
+/// The entry of the variable's own type is true for every variable, including the first one of each type.
+void add_is_type_member(type_id type,
+                        const type_table &types,
+                        const vector<string> &enclosing_idents,
                         mustache::data &data)
 {
-    string this_classes_ident;
-    if(type_definitions.count(type_node.uniqueID()))
-    {
-        const auto &classdef = type_definitions.find(type_node.uniqueID())->second;
-        this_classes_ident = classdef.class_name;
-    } else {
-        // its not a class, which was found, but either an unresolved class type (without refid) or a builtin type
-        // (int, float..)
-        this_classes_ident = make_pure_type_printable(type_node.pure_type);
+    const string this_classes_ident = get_is_type_ident(type, types);
+    if(!types.find_definition(type))
         data.set("is_builtin_type", mustache::data::type::bool_true);
-    }
 
-    static set<string> all_entries;
-    for (const auto &a : all_entries)
-    {
-        if (a == this_classes_ident)
-            data.set("is_" + a, mustache::data::type::bool_true);
-        else
-            data.set("is_" + a, mustache::data::type::bool_false);
-    }
-    all_entries.insert(this_classes_ident);
+    for(const string &enclosing : enclosing_idents)
+        data.set("is_" + enclosing, mustache::data::type::bool_false);
+    data.set("is_" + this_classes_ident, mustache::data::type::bool_true);
 }
 
 /// Add all template data entries corresponding to the type information of the variable.
-void add_type_node_data(const SharedVariable::type_node_t &type_node,
-                        const unordered_map<string, shared_class_definition> &type_definitions,
+/// Entries no template uses get left out.
+/// The printed names get cached in the type table, since all definitions are known by now.
+/// @param enclosing_idents the "is_<type>" idents of the data this data gets nested in.
+void add_type_node_data(type_id type,
+                        type_table &types,
+                        const used_template_keys &used_keys,
+                        const vector<string> &enclosing_idents,
                         mustache::data &data)
 {
-    add_is_type_member(type_node, type_definitions, data);
-    data.set("type_name_cpp", print_full_type(type_node, type_definitions));
-    data.set("type_name_unique", print_full_type(type_node, type_definitions, "__", "_", "__", true));
+    if(used_keys.is_any_used_with_prefix("is_"))
+        add_is_type_member(type, types, enclosing_idents, data);
+    if(used_keys.is_used("type_name_cpp"))
+    {
+        if(types[type].type_name_cpp.empty())
+            types[type].type_name_cpp = print_full_type(type, types);
+        data.set("type_name_cpp", types[type].type_name_cpp);
+    }
+    if(used_keys.is_used("type_name_unique"))
+    {
+        if(types[type].type_name_unique.empty())
+            types[type].type_name_unique = print_full_type(type, types, "__", "_", "__", true);
+        data.set("type_name_unique", types[type].type_name_unique);
+    }
 
+    if(!used_keys.is_used("template_types")) return;
+    vector<string> template_enclosing_idents(enclosing_idents);
+    if(used_keys.is_any_used_with_prefix("is_"))
+        template_enclosing_idents.push_back(get_is_type_ident(type, types));
     mustache::data tmpl_data{mustache::data::type::list};
-    for (const auto &t : type_node.template_types)
+    for (const type_id t : types[type].template_types)
     {
         mustache::data t_data{mustache::data::type::object};
-        add_type_node_data(t, type_definitions, t_data);
+        add_type_node_data(t, types, used_keys, template_enclosing_idents, t_data);
         tmpl_data.push_back(t_data);
     }
     data.set("template_types", tmpl_data);
@@ -323,13 +374,16 @@ string get_path_of_var(const SharedVariable &var)
 }
 
 /// Print all data corresponding to a specific shared variable, set an index for each.
+/// @param enclosing_idents see add_type_node_data.
 mustache::data get_shared_var_templatedata(const SharedVariable &var,
-                                           const unordered_map<string, shared_class_definition> &type_definitions,
-                                           const unordered_map<string, attribute_definition> &attribute_definitions,
+                                           type_table &types,
+                                           attribute_resolver &attributes,
+                                           const used_template_keys &used_keys,
+                                           const vector<string> &enclosing_idents,
                                            size_t index)
 {
     mustache::data curvariable{mustache::data::type::object};
-    add_type_node_data(var.type, type_definitions, curvariable);
+    add_type_node_data(types.intern(var.type), types, used_keys, enclosing_idents, curvariable);
     //if(local_index>0) curvariable.set("local_index", std::to_string(local_index));
 
     mustache::data ns{mustache::data::type::list};
@@ -337,58 +391,67 @@ mustache::data get_shared_var_templatedata(const SharedVariable &var,
         ns.push_back(mustache::data(ns_part));
     curvariable.set("namespace", ns);
     curvariable.set("name", var.name);
-    curvariable.set("path", get_path_of_var(var));
+    if(used_keys.is_used("path"))
+        curvariable.set("path", get_path_of_var(var));
     curvariable.set("index", to_string(index));
 
-    add_attached_attributes_templatedata(curvariable, var.attached_attributes, attribute_definitions);
+    if(used_keys.is_used("attached_attributes"))
+        attributes.add_attached_attributes_templatedata(curvariable, var.attached_attributes);
 
     return curvariable;
 }
 
 kainjow::mustache::data print_shared_var_occurences(const vector<SharedVariable> &shared_var_occurences,
-                                                    const unordered_map<string, shared_class_definition> &type_definitions,
-                                                    const unordered_map<string, attribute_definition> &attribute_definitions)
+                                                    type_table &types,
+                                                    attribute_resolver &attributes,
+                                                    const used_template_keys &used_keys)
 {
     int index = 21;
     mustache::data sharedvars{mustache::data::type::list};
 
+    const vector<string> no_enclosing_idents;
     for(const auto &shared_var : shared_var_occurences)
     {
-        sharedvars.push_back(get_shared_var_templatedata(shared_var, type_definitions, attribute_definitions, index++));
+        sharedvars.push_back(get_shared_var_templatedata(shared_var, types, attributes, used_keys,
+                                                         no_enclosing_idents, index++));
     }
     return sharedvars;
 }
 
 /// Create a shared class definition which the
 mustache::data get_shared_class_templatedata(const shared_class_definition &def,
-                                             const unordered_map<string, shared_class_definition> &type_definitions,
-                                             const unordered_map<string, attribute_definition> &attribute_definitions)
+                                             type_table &types,
+                                             attribute_resolver &attributes,
+                                             const used_template_keys &used_keys)
 {
     mustache::data cur_definition{mustache::data::type::object};
     // The class needs to be defined in a cleanly includeable header file.
     cur_definition.set("header", def.definition_header);
 
-    add_type_node_data(def.type_node, type_definitions, cur_definition);
+    add_type_node_data(def.type, types, used_keys, vector<string>(), cur_definition);
 
     mustache::data members{mustache::data::type::list};
 
+    const vector<string> member_enclosing_idents{get_is_type_ident(def.type, types)};
     int local_index = 2;
     for(const SharedVariable &child : def.elements)
     {
-        members.push_back(get_shared_var_templatedata(child, type_definitions, attribute_definitions, local_index++));
+        members.push_back(get_shared_var_templatedata(child, types, attributes, used_keys,
+                                                      member_enclosing_idents, local_index++));
     }
     cur_definition.set("members", members);
     return cur_definition;
 }
 
-mustache::data print_type_definitions(const unordered_map<string, shared_class_definition> &type_definitions,
-                                      const unordered_map<string, attribute_definition> &attribute_definitions)
+mustache::data print_type_definitions(type_table &types,
+                                      attribute_resolver &attributes,
+                                      const used_template_keys &used_keys)
 {
     mustache::data sharedclasses{mustache::data::type::list};
 
-    for(const auto &class_def : type_definitions)
+    for(const auto &class_def : types.definitions())
     {
-        sharedclasses.push_back(get_shared_class_templatedata(class_def.second, type_definitions, attribute_definitions));
+        sharedclasses.push_back(get_shared_class_templatedata(class_def, types, attributes, used_keys));
     }
     return sharedclasses;
 
@@ -401,9 +464,9 @@ mustache::data print_attribute_definitions(const unordered_map<string, attribute
     int index = 50005;
     // TODO: make this index configurable
     // e.g. by defining an entry in the xml like "<index startval=xy name=optionindex />
-    for(auto &deftupel : attribute_definitions)
+    for(const attribute_definition *sorted_def : sorted_attribute_definitions(attribute_definitions))
     {
-        auto &def = deftupel.second;
+        auto &def = *sorted_def;
         mustache::data attribute_data{mustache::data::type::object};
         attribute_data.set("name", def.name);
         mustache::data constructor_args_data{mustache::data::type::list};
@@ -424,13 +487,22 @@ mustache::data print_attribute_definitions(const unordered_map<string, attribute
 }
 
 mustache::data print_data(const vector<SharedVariable> &var_occurences,
-                          const unordered_map<string, shared_class_definition> &type_definitions,
-                          const unordered_map<string, attribute_definition> &attribute_definitions)
+                          type_table &types,
+                          const unordered_map<string, attribute_definition> &attribute_definitions,
+                          used_template_keys used_keys)
 {
+    // the default values of attribute constructor args are templates as well, rendered with the data of the variable.
+    for(const auto &deftupel : attribute_definitions)
+        for(const auto &constructor : deftupel.second.constructors)
+            for(const function_parameter &arg : constructor.constructor_args)
+                used_keys.add_template(arg.default_value);
+
+    attribute_resolver attributes(attribute_definitions);
+
     mustache::data data{mustache::data::type::object};
     data.set("attribute_definitions", print_attribute_definitions(attribute_definitions));
-    data.set("type_definitions", print_type_definitions(type_definitions, attribute_definitions));
-    data.set("variables", print_shared_var_occurences(var_occurences, type_definitions, attribute_definitions));
+    data.set("type_definitions", print_type_definitions(types, attributes, used_keys));
+    data.set("variables", print_shared_var_occurences(var_occurences, types, attributes, used_keys));
 
     data.set("file_comment", "// This file gets generated!\n"
             "// Do not modify it directly but its corresponding template file instead!");
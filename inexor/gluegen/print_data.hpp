@@ -1,6 +1,8 @@
 #pragma once
 
 #include "inexor/gluegen/SharedAttributes.hpp"
+#include "inexor/gluegen/SharedVarDatatypes.hpp"
+#include "inexor/gluegen/template_keys.hpp"
 #include <kainjow/mustache.hpp>
 
 #include <vector>
@@ -9,13 +11,14 @@
 namespace inexor {
 namespace gluegen {
 
-struct SharedVariable;
-struct shared_class_definition;
-
+/// Builds the template data for all found variables, types and attributes.
+/// @param types the interned types with their class definitions, the printed names get cached in it.
+/// @param used_keys optional entries which none of the templates use get left out.
 extern kainjow::mustache::data print_data(
         const std::vector<SharedVariable> &shared_var_occurences,
-        const std::unordered_map<std::string, shared_class_definition> &type_definitions,
-        const std::unordered_map<std::string, attribute_definition> &attribute_definitions);
+        type_table &types,
+        const std::unordered_map<std::string, attribute_definition> &attribute_definitions,
+        used_template_keys used_keys = used_template_keys());
 
 }
 }
@@ -1,5 +1,8 @@
 
 #include "inexor/gluegen/render_files.hpp"
+#include "inexor/gluegen/binary_records.hpp"
+#include "inexor/gluegen/parallel.hpp"
+#include "inexor/gluegen/stage_timings.hpp"
 #include "inexor/filesystem/path.hpp"
 
 #include <pugiconfig.hpp>
@@ -7,7 +10,10 @@
 
 #include <kainjow/mustache.hpp>
 
+#include <boost/filesystem.hpp>
+
 #include <fstream>
+#include <unordered_map>
 
 using namespace pugi;
 using namespace kainjow;
@@ -17,64 +23,230 @@ using namespace inexor::filesystem;
 namespace inexor {
 namespace gluegen {
 
-/// Create a file containing the given content.
-void save_to_file(const std::string &filepath, const std::string &file_content)
+/// Prints what happened to a rendered file.
+void print_save_result(const std::string &filepath, file_update_stream::result result)
+{
+    switch(result)
+    {
+        case file_update_stream::UNCHANGED:
+            std::cout << "Rendering C++ GlueGen file completed, unchanged (" << filepath << ")" << std::endl;
+            break;
+        case file_update_stream::WRITTEN:
+            std::cout << "Rendering C++ GlueGen file completed (" << filepath << ")" << std::endl;
+            break;
+        case file_update_stream::FAILED:
+            std::cerr << "ERROR: Could not write the rendered file " << filepath << std::endl;
+            break;
+    }
+}
+
+/// Increase this whenever the template record layout changes, old records get ignored afterwards.
+static const uint32_t template_format_version = 1;
+static const char template_magic[4] = {'I', 'G', 'G', 'T'};
+
+void write_named_templates(record_writer &out, const std::vector<template_file::named_template> &templates)
+{
+    out.write_u32(static_cast<uint32_t>(templates.size()));
+    for(const auto &templ : templates)
+    {
+        out.write_string(templ.name);
+        out.write_string(templ.text);
+    }
+}
+
+void read_named_templates(record_reader &in, std::vector<template_file::named_template> &templates)
+{
+    for(uint32_t i = 0, count = in.read_u32(); in.ok && i < count; i++)
+    {
+        template_file::named_template templ;
+        templ.name = in.read_string();
+        templ.text = in.read_string();
+        templates.push_back(std::move(templ));
+    }
+}
+
+/// Loads the template file stored for this key in the cache folder. Returns false if there is none (or it is unreadable).
+bool load_cached_template_file(const Path &cache_folder, uint64_t key, template_file &templ)
+{
+    mapped_file record(cache_folder / record_file_name(key, ".template"));
+    if(!record.is_open()) return false;
+
+    record_reader in(record.data(), record.size());
+    if(!in.read_header(template_magic, template_format_version)) return false;
+    template_file loaded;
+    read_named_templates(in, loaded.partials);
+    read_named_templates(in, loaded.files);
+    if(!in.done()) return false;
+
+    templ = std::move(loaded);
+    return true;
+}
+
+void store_cached_template_file(const Path &cache_folder, uint64_t key, const template_file &templ)
 {
-    std::ofstream sink{filepath, std::ofstream::trunc};
-    sink << file_content;
-    std::cout << "Rendering C++ GlueGen file completed (" << filepath << ")" << std::endl;
+    record_writer out;
+    out.write_header(template_magic, template_format_version);
+    write_named_templates(out, templ.partials);
+    write_named_templates(out, templ.files);
+
+    const Path record_path = cache_folder / record_file_name(key, ".template");
+    if(!write_file_atomically(record_path, out.buffer.data(), out.buffer.size()))
+        std::cerr << "Could not write template cache record " << record_path << std::endl;
 }
 
-void render_files(mustache::data &tmpldata,
-                  const std::vector<std::string> &partial_files,
-                  const std::vector<std::string> &template_files,
-                  const string &output_folder)
+/// Parses a template file xml and checks all partials for errors.
+/// Returns false if the xml could not be parsed, sets partials_valid to false if any partial is malformatted.
+bool parse_template_file(const string &file, mapped_file &buffer, template_file &templ, bool &partials_valid)
 {
+    // the node strings point into buffer, it needs to outlive xml.
+    auto xml = make_unique<xml_document>();
+    pugi::xml_parse_result result = xml->load_buffer_inplace(buffer.data(), buffer.size(), parse_default|parse_trim_pcdata);
+    if(!result)
+    {
+        std::cout << "XML file defining the rendering template couldn't be parsed: " << file << "\n"
+        << result.description() << std::endl;
+        return false;
+    }
+
+    partials_valid = true;
+    for (auto &a : xml->children("partial"))
+    {
+        template_file::named_template partial{a.attribute("name").value(), a.child_value()};
+        mustache::mustache tmpl{partial.text};
+        if(!tmpl.is_valid())
+        {
+            std::cout << "Error in template file (" << file << "). Malformatted partial (" << partial.name << "):\n"
+                        << tmpl.error_message() << std::endl;
+            partials_valid = false;
+        }
+        templ.partials.push_back(std::move(partial));
+    }
+    for(auto &a : xml->children("file"))
+        templ.files.push_back({a.attribute("filename").value(), a.child_value()});
+    return true;
+}
+
+std::vector<template_file> load_template_files(const std::vector<std::string> &partial_files,
+                                               const std::vector<std::string> &template_files,
+                                               const string &cache_folder)
+{
+    if(!cache_folder.empty())
+    {
+        boost::system::error_code err;
+        boost::filesystem::create_directories(cache_folder, err);
+    }
+    const uint64_t cache_config_hash = fnv1a_hash(gluegen_version, sizeof(gluegen_version));
+
+    std::vector<template_file> templates;
     for(const string &file : template_files)
     {
-        auto xml = make_unique<xml_document>();
-        pugi::xml_parse_result result = xml->load_file(file.c_str(), parse_default|parse_trim_pcdata);
-        if(!result)
+        mapped_file buffer(file);
+        if(!buffer.is_open())
         {
-            std::cout << "XML file defining the rendering template couldn't be parsed: " << file << "\n"
-            << result.description() << std::endl;
-            return;
+            std::cout << "XML file defining the rendering template couldn't be opened: " << file << std::endl;
+            break;
         }
-        // template data is just for this file, since we are adding partials
-        mustache::data local_tmpldata(tmpldata);
 
-        // firstly add all defined partials, each adding its contents to the template data
+        // cached template files got parsed and their partials checked already, we skip both.
+        template_file templ;
+        const uint64_t cache_key = fnv1a_hash(buffer.data(), buffer.size(), cache_config_hash);
+        if(cache_folder.empty() || !load_cached_template_file(cache_folder, cache_key, templ))
+        {
+            bool partials_valid = false;
+            if(!parse_template_file(file, buffer, templ, partials_valid))
+                break;
+            // only error free files get cached, so the errors get reported again next time.
+            if(!cache_folder.empty() && partials_valid)
+                store_cached_template_file(cache_folder, cache_key, templ);
+        }
+        templ.source_file = file;
+        templates.push_back(std::move(templ));
+    }
+    return templates;
+}
+
+void render_files(const mustache::data &tmpldata,
+                  const std::vector<template_file> &templates,
+                  const string &output_folder,
+                  size_t jobs)
+{
+    // firstly add the partials of each template file to an overlay for it.
+    // The partials are just for this file, so they go into an overlay on top of the shared template data.
+    // Lookups check the overlay first and fall through to tmpldata, which hence does not need to be copied.
+    std::vector<mustache::data> overlays;
+    for(const template_file &templ : templates)
+    {
+        mustache::data local_tmpldata{mustache::data::type::object};
+
         // the content will be executed in place.
-        for (auto &a : xml->children("partial"))
+        for (const auto &partial : templ.partials)
         {
-            const string partial_name = a.attribute("name").value();
-            const string partial_templ = a.child_value();
-            mustache::mustache tmpl{partial_templ};
-            if(!tmpl.is_valid())
-                std::cout << "Error in template file (" << file << "). Malformatted partial (" << partial_name << "):\n"
-                            << tmpl.error_message() << std::endl;
+            const string partial_templ = partial.text;
             kainjow::mustache::partial partial_value([partial_templ]() {
                 return partial_templ;
             });
-            local_tmpldata.set(partial_name, partial_value);
+            local_tmpldata.set(partial.name, partial_value);
         }
+        overlays.push_back(std::move(local_tmpldata));
+    }
 
-        // secondly render all files, using the templatedata
-        for(auto &a : xml->children("file"))
+    /// A single <file> entry of one of the template files.
+    struct render_job
+    {
+        size_t template_index;
+        const template_file::named_template *file_entry;
+        Path file_path;
+        file_update_stream::result result;
+        std::string error;
+    };
+    std::vector<render_job> render_jobs;
+    for(size_t t = 0; t < templates.size(); t++)
+        for(const auto &file_entry : templates[t].files)
+            render_jobs.push_back({t, &file_entry, Path(output_folder) / file_entry.name, file_update_stream::FAILED, string()});
+
+    // Jobs writing to the same file need to run one after another (in order), so the last one wins as usual.
+    std::vector<std::vector<size_t>> jobs_per_file;
+    std::unordered_map<string, size_t> file_index;
+    for(size_t i = 0; i < render_jobs.size(); i++)
+    {
+        auto inserted = file_index.emplace(render_jobs[i].file_path.string(), jobs_per_file.size());
+        if(inserted.second) jobs_per_file.emplace_back();
+        jobs_per_file[inserted.first->second].push_back(i);
+    }
+
+    // secondly render all files, using the templatedata.
+    // Each one only reads the template data and renders into its own file, so they can run concurrently.
+    // The rendered contents get streamed into the file (or just compared with it), without building them in memory.
+    parallel_for(jobs_per_file.size(), jobs, [&](size_t f)
+    {
+        for(const size_t i : jobs_per_file[f])
         {
-            const Path file_name = a.attribute("filename").value();
-            const Path file_path = Path(output_folder) / file_name;
-            const string file_templ = a.child_value();
-            mustache::mustache tmpl{file_templ};
+            render_job &job = render_jobs[i];
+            stage_timings::detail_scope trace("render_file", job.file_entry->name);
+            mustache::mustache tmpl{job.file_entry->text};
             if(!tmpl.is_valid())
-                std::cout << "Error in template file (" << file << "). Malformatted file content (" << file_name << "):\n"
-                            << tmpl.error_message() << std::endl;
+                job.error = "Error in template file (" + templates[job.template_index].source_file + "). Malformatted file content ("
+                            + job.file_entry->name + "):\n" + tmpl.error_message();
 
-            const string file_content = tmpl.render(local_tmpldata);
-            save_to_file(file_path.string(), file_content);
+            mustache::context<string> layered_context(&tmpldata);
+            layered_context.push(&overlays[job.template_index]);
+            file_update_stream sink(job.file_path);
+            tmpl.render(layered_context, sink);
+            job.result = sink.commit();
         }
+    });
+
+    // lastly report them in order, so the output stays the same as when rendering them one after another.
+    size_t saved_files[3] = {0, 0, 0}; // indexed by file_update_stream::result
+    for(const render_job &job : render_jobs)
+    {
+        if(!job.error.empty()) std::cout << job.error << std::endl;
+        print_save_result(job.file_path.string(), job.result);
+        saved_files[job.result]++;
     }
+    std::cout << "Rendered files: " << saved_files[file_update_stream::WRITTEN] << " written, "
+              << saved_files[file_update_stream::UNCHANGED] << " unchanged, "
+              << saved_files[file_update_stream::FAILED] << " failed" << std::endl;
 }
-
 }
 }
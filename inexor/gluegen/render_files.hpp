@@ -8,10 +8,36 @@
 namespace inexor {
 namespace gluegen {
 
+    /// The contents of a template_file xml: the mustache templates of partials and of the files to render.
+    struct template_file
+    {
+        struct named_template
+        {
+            std::string name;
+            std::string text;
+        };
+        std::vector<named_template> partials;
+        /// The name is the filename of the file to render.
+        std::vector<named_template> files;
+
+        /// The xml file this got loaded from.
+        std::string source_file;
+    };
+
     /// We load the xml files which are containing definitions of mustache partials, or the filename plus the mustache
-    /// template for a file we want to generate using the templatedata given.
-    extern void render_files(kainjow::mustache::data &tmpldata, const std::vector<std::string> &partial_files,
-                             const std::vector<std::string> &template_files,
-                             const std::string &output_folder);
+    /// template for a file we want to generate.
+    /// If one of them can not be loaded, only the ones before it get returned.
+    /// @param cache_folder if not empty, the parsed template files get cached there (keyed by their content).
+    extern std::vector<template_file> load_template_files(const std::vector<std::string> &partial_files,
+                                                          const std::vector<std::string> &template_files,
+                                                          const std::string &cache_folder = std::string());
+
+    /// Render the files of all template files using the templatedata given.
+    /// @param tmpldata the data shared by all template files, it does not get copied or altered.
+    /// @param jobs the number of threads rendering files concurrently (0 = one per hardware thread).
+    extern void render_files(const kainjow::mustache::data &tmpldata,
+                             const std::vector<template_file> &templates,
+                             const std::string &output_folder,
+                             size_t jobs = 1);
 }
 }
@@ -0,0 +1,616 @@
+
+#include "inexor/gluegen/source_scanner.hpp"
+#include "inexor/gluegen/parse_helpers.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace inexor { namespace gluegen {
+
+namespace {
+
+struct token
+{
+    enum kind_t { IDENTIFIER, LITERAL, PUNCTUATION } kind;
+    /// Offsets into the source.
+    size_t begin, end;
+};
+
+inline bool is_identifier_start(char c) { return isalpha(static_cast<unsigned char>(c)) || c == '_'; }
+inline bool is_identifier_char(char c) { return isalnum(static_cast<unsigned char>(c)) || c == '_'; }
+
+/// Whether an identifier directly in front of a quote is an encoding prefix (u8"", L'') or marks a raw string (R"()").
+bool is_literal_prefix(const char *str, size_t len)
+{
+    static const char *prefixes[] = {"u8", "u", "U", "L", "R", "u8R", "uR", "UR", "LR"};
+    for(const char *prefix : prefixes)
+        if(strlen(prefix) == len && memcmp(prefix, str, len) == 0) return true;
+    return false;
+}
+
+/// Returns the position behind the string or char literal whose quote is at quote_pos.
+size_t skip_quoted(const char *data, size_t size, size_t start, size_t quote_pos)
+{
+    const char quote = data[quote_pos];
+    if(quote == '"' && quote_pos > start && data[quote_pos-1] == 'R') // R"delim( ... )delim"
+    {
+        size_t open = quote_pos + 1;
+        while(open < size && data[open] != '(') open++;
+        const string terminator = ")" + string(data + quote_pos + 1, open - quote_pos - 1) + "\"";
+        const char *found = std::search(data + open, data + size, terminator.begin(), terminator.end());
+        return found == data + size ? size : (found - data) + terminator.size();
+    }
+    size_t i = quote_pos + 1;
+    for(; i < size && data[i] != quote && data[i] != '\n'; i++)
+        if(data[i] == '\\') i++;
+    return min(i + 1, size);
+}
+
+/// Splits the source into tokens, skipping whitespace, comments and preprocessor lines.
+vector<token> tokenize(const char *data, size_t size)
+{
+    vector<token> tokens;
+    bool line_start = true; // only whitespace since the last newline
+    size_t i = 0;
+    while(i < size)
+    {
+        const char c = data[i];
+        if(c == '\n')
+        {
+            line_start = true;
+            i++;
+            continue;
+        }
+        if(isspace(static_cast<unsigned char>(c)))
+        {
+            i++;
+            continue;
+        }
+        if(c == '/' && i+1 < size && data[i+1] == '/')
+        {
+            while(i < size && data[i] != '\n') i++;
+            continue;
+        }
+        if(c == '/' && i+1 < size && data[i+1] == '*')
+        {
+            i += 2;
+            while(i+1 < size && !(data[i] == '*' && data[i+1] == '/')) i++;
+            i = min(i + 2, size);
+            continue;
+        }
+        if(c == '#' && line_start) // a preprocessor directive, possibly continued over several lines.
+        {
+            for(; i < size && data[i] != '\n'; i++)
+                if(data[i] == '\\' && i+1 < size && (data[i+1] == '\n' || data[i+1] == '\r')) i += data[i+1] == '\r' ? 2 : 1;
+            continue;
+        }
+        line_start = false;
+
+        const size_t start = i;
+        token::kind_t kind = token::PUNCTUATION;
+        if(is_identifier_start(c))
+        {
+            while(i < size && is_identifier_char(data[i])) i++;
+            kind = token::IDENTIFIER;
+            if(i < size && (data[i] == '"' || data[i] == '\'') && is_literal_prefix(data + start, i - start))
+            {
+                i = skip_quoted(data, size, start, i);
+                kind = token::LITERAL;
+            }
+        }
+        else if(isdigit(static_cast<unsigned char>(c)) || (c == '.' && i+1 < size && isdigit(static_cast<unsigned char>(data[i+1]))))
+        {
+            for(i++; i < size; i++)
+            {
+                if(is_identifier_char(data[i]) || data[i] == '.') continue;
+                if(data[i] == '\'' && i+1 < size && is_identifier_char(data[i+1])) continue; // digit separator
+                if((data[i] == '+' || data[i] == '-') && strchr("eEpP", data[i-1])) continue; // exponent sign
+                break;
+            }
+            kind = token::LITERAL;
+        }
+        else if(c == '"' || c == '\'')
+        {
+            i = skip_quoted(data, size, start, i);
+            kind = token::LITERAL;
+        }
+        else if(c == ':' && i+1 < size && data[i+1] == ':') i += 2;
+        else i++;
+        tokens.push_back({kind, start, i});
+    }
+    return tokens;
+}
+
+/// Where a declaration is found and what surrounds it.
+struct scope_context
+{
+    /// The namespaces and classes around, e.g. "inexor", "rendering", "Screen".
+    vector<string> names;
+
+    /// Set inside the body of a class (a usual one or an attribute class).
+    class_compound *compound = nullptr;
+    scanned_attribute_class *attribute = nullptr;
+
+    /// The name of the class we are in (without namespace), its constructors have the same name.
+    string class_name;
+
+    /// Inside a class: whether the declarations are public at this point.
+    bool is_public = true;
+};
+
+/// Recursive descent over the tokens of one file, only looking at what gluegen needs.
+class declaration_parser
+{
+    const char *data;
+    const vector<token> &tokens;
+    const string &file_name;
+    scanned_source_file &out;
+    size_t pos = 0;
+
+    bool is(size_t i, const char *str) const
+    {
+        if(i >= tokens.size()) return false;
+        const size_t len = tokens[i].end - tokens[i].begin;
+        return strlen(str) == len && memcmp(data + tokens[i].begin, str, len) == 0;
+    }
+    bool is_identifier(size_t i) const { return i < tokens.size() && tokens[i].kind == token::IDENTIFIER; }
+    bool is_opening(size_t i) const { return is(i, "(") || is(i, "[") || is(i, "{"); }
+    bool is_closing(size_t i) const { return is(i, ")") || is(i, "]") || is(i, "}"); }
+
+    string text(size_t i) const { return string(data + tokens[i].begin, tokens[i].end - tokens[i].begin); }
+
+    /// The source text of the tokens [first, last) as written.
+    string source_text(size_t first, size_t last) const
+    {
+        if(first >= last) return string();
+        return string(data + tokens[first].begin, tokens[last-1].end - tokens[first].begin);
+    }
+
+    /// Returns the position behind the bracket matching the one at i.
+    size_t skip_balanced(size_t i) const
+    {
+        int depth = 0;
+        for(; i < tokens.size(); i++)
+        {
+            if(is_opening(i)) depth++;
+            else if(is_closing(i) && --depth == 0) return i + 1;
+        }
+        return tokens.size();
+    }
+
+    /// Returns the position behind the '>' matching the '<' at i.
+    size_t skip_angles(size_t i) const
+    {
+        int depth = 0;
+        while(i < tokens.size())
+        {
+            if(is(i, ";") || is_closing(i)) return i; // malformed, do not leave the statement.
+            if(is_opening(i))
+            {
+                i = skip_balanced(i);
+                continue;
+            }
+            if(is(i, "<")) depth++;
+            else if(is(i, ">") && --depth == 0) return i + 1;
+            i++;
+        }
+        return i;
+    }
+
+    /// Returns the position of the ';', '{' or '}' terminating the statement starting at i.
+    /// Brackets in between get skipped, just as braces of initializers and of member initializer lists.
+    size_t find_statement_end(size_t i) const
+    {
+        bool seen_assign = false, in_initializer_list = false;
+        while(i < tokens.size())
+        {
+            if(is(i, ";") || is(i, "}")) return i;
+            if(is(i, "{"))
+            {
+                const bool is_initializer = seen_assign
+                    || (in_initializer_list && (is_identifier(i-1) || is(i-1, ">")));
+                if(!is_initializer) return i;
+            }
+            if(is_opening(i))
+            {
+                i = skip_balanced(i);
+                continue;
+            }
+            if(is(i, "=") && !is(i-1, "operator")) seen_assign = true;
+            if(is(i, ":") && is(i-1, ")")) in_initializer_list = true;
+            i++;
+        }
+        return i;
+    }
+
+    /// Moves behind the next ';' of this scope (or to its closing '}').
+    void skip_to_semicolon()
+    {
+        while(pos < tokens.size() && !is(pos, "}"))
+        {
+            if(is(pos, ";"))
+            {
+                pos++;
+                return;
+            }
+            pos = is_opening(pos) ? skip_balanced(pos) : pos + 1;
+        }
+    }
+
+    /// Splits [first, last) at the commas which are not inside brackets or template arguments.
+    vector<pair<size_t, size_t>> split_at_commas(size_t first, size_t last) const
+    {
+        vector<pair<size_t, size_t>> parts;
+        size_t part_start = first;
+        for(size_t i = first; i < last;)
+        {
+            if(is(i, ","))
+            {
+                parts.emplace_back(part_start, i);
+                part_start = ++i;
+            }
+            else if(is_opening(i)) i = skip_balanced(i);
+            else if(is(i, "<")) i = skip_angles(i);
+            else i++;
+        }
+        if(part_start < last) parts.emplace_back(part_start, last);
+        return parts;
+    }
+
+    /// The names of the parameters between template< and >, empty for unnamed ones.
+    vector<string> parse_template_params(size_t first, size_t last) const
+    {
+        vector<string> params;
+        for(const auto &part : split_at_commas(first, last))
+        {
+            size_t end = part.first;
+            while(end < part.second && !is(end, "=")) end++;
+            // "typename T", "class U", "int N": the name is the last word if there is more than one.
+            params.push_back(end - part.first >= 2 && is_identifier(end-1) ? text(end-1) : string());
+        }
+        return params;
+    }
+
+    /// Parses the parameters of a constructor between the brackets, the default values stay raw.
+    vector<function_parameter> parse_params(size_t first, size_t last) const
+    {
+        vector<function_parameter> params;
+        for(const auto &part : split_at_commas(first, last))
+        {
+            size_t assign = part.first;
+            while(assign < part.second && !is(assign, "=")) assign++;
+
+            function_parameter param;
+            if(assign - part.first >= 2 && is_identifier(assign-1))
+            {
+                param.name = text(assign-1);
+                param.type = source_text(part.first, assign-1);
+            }
+            else param.type = source_text(part.first, assign);
+            if(param.name.empty() && param.type == "void") continue;
+            if(assign < part.second) param.default_value = source_text(assign+1, part.second);
+            params.push_back(param);
+        }
+        return params;
+    }
+
+    static bool is_type_qualifier(const string &word)
+    {
+        static const char *qualifiers[] = {"const", "volatile", "static", "extern", "inline", "constexpr", "mutable",
+                                           "thread_local", "typename", "struct", "class", "enum", "register"};
+        for(const char *q : qualifiers) if(word == q) return true;
+        return false;
+    }
+
+    /// Parses a type like "const inexor::SharedMap<int, SharedVar<float>>" into a type tree, starting at i.
+    SharedVariable::type_node_t parse_type(size_t &i, size_t last) const
+    {
+        SharedVariable::type_node_t node;
+        string name;
+        for(; i < last; i++)
+        {
+            if(is(i, "::")) name += "::";
+            else if(is_identifier(i))
+            {
+                const string word = text(i);
+                if(is_type_qualifier(word)) continue;
+                // multi word builtin types like "unsigned int".
+                if(!name.empty() && name.back() != ':') name += ' ';
+                name += word;
+            }
+            else break;
+        }
+        if(name.empty() && i < last && tokens[i].kind == token::LITERAL) name = text(i++); // a non-type template argument
+
+        if(i < last && is(i, "<"))
+        {
+            for(i++; i < last && !is(i, ">");)
+            {
+                node.template_types.push_back(parse_type(i, last));
+                // skip the rest of this argument (pointers, references, expressions).
+                while(i < last && !is(i, ",") && !is(i, ">"))
+                {
+                    if(is_opening(i)) i = skip_balanced(i);
+                    else if(is(i, "<")) i = skip_angles(i);
+                    else i++;
+                }
+                if(is(i, ",")) i++;
+            }
+            if(i < last) i++;
+        }
+        node.pure_type = name;
+        node.refid = name; // as doxygen does for types it does not know, we resolve them later on.
+        return node;
+    }
+
+    /// A declaration (not a class or namespace) in [first, last), terminated by the token at last.
+    void handle_declaration(const scope_context &ctx, size_t first, size_t last)
+    {
+        if(ctx.attribute)
+        {
+            if(!ctx.is_public) return;
+            size_t i = first;
+            while(i < last && (is(i, "explicit") || is(i, "constexpr") || is(i, "inline"))) i++;
+            if(i+1 < last && is_identifier(i) && text(i) == ctx.class_name && is(i+1, "("))
+                ctx.attribute->constructors.push_back(parse_params(i+2, skip_balanced(i+1) - 1));
+            return;
+        }
+        if(ctx.compound && !ctx.is_public) return;
+
+        // the name is in front of the initializer: "type name = ..", "type name(..)" or "type name{..}".
+        size_t name_pos = last;
+        string initializer;
+        for(size_t i = first; i < last; i++)
+        {
+            if(is(i, "<"))
+            {
+                i = skip_angles(i) - 1;
+                continue;
+            }
+            if(is(i, "=") || is(i, "("))
+            {
+                if(i > first + 1 && is_identifier(i-1))
+                {
+                    name_pos = i - 1;
+                    initializer = is(i, "=") ? "= " + source_text(i+1, last) : source_text(i, last);
+                }
+                break;
+            }
+        }
+        if(name_pos == last && is(last, "{") && last > first + 1 && is_identifier(last-1))
+        {
+            name_pos = last - 1;
+            initializer = source_text(last, skip_balanced(last));
+        }
+        if(name_pos == last) return;
+        const size_t marker_pos = find_reflection_marker(initializer);
+        if(marker_pos == string::npos) return;
+
+        size_t type_pos = first;
+        const SharedVariable::type_node_t type = parse_type(type_pos, name_pos);
+        if(ctx.compound)
+        {
+            // members are in the namespace of the class definition (see parse_class_compound).
+            const vector<string> definition_namespace(ctx.names.begin(), ctx.names.end() - 1);
+            ctx.compound->marked_members.emplace_back(type, text(name_pos), definition_namespace, initializer, marker_pos);
+        }
+        else out.shared_vars.emplace_back(type, text(name_pos), ctx.names, initializer, marker_pos);
+    }
+
+    /// A class definition in [first, open), the body starts at open.
+    void parse_class(const scope_context &ctx, size_t first, size_t open, const vector<string> &template_params)
+    {
+        const bool is_class_key = is(first, "class");
+        size_t colon = first + 1;
+        while(colon < open && !is(colon, ":"))
+            colon = is_opening(colon) ? skip_balanced(colon) : colon + 1;
+
+        size_t name_pos = colon - 1;
+        if(is(name_pos, "final")) name_pos--;
+        if(name_pos <= first || !is_identifier(name_pos)) // unnamed classes and specializations are of no interest.
+        {
+            pos = skip_balanced(open);
+            skip_to_semicolon();
+            return;
+        }
+        const string name = text(name_pos);
+
+        bool is_attribute = false;
+        if(colon < open)
+            for(const auto &base : split_at_commas(colon + 1, open))
+            {
+                size_t base_name = base.first;
+                for(size_t i = base.first; i < base.second && !is(i, "<"); i++)
+                    if(is_identifier(i)) base_name = i;
+                if(is_identifier(base_name) && text(base_name) == "SharedOption") is_attribute = true;
+            }
+
+        scope_context inner;
+        inner.names = ctx.names;
+        inner.names.push_back(name);
+        inner.class_name = name;
+        inner.is_public = !is_class_key;
+
+        string full_name;
+        for(const string &part : inner.names) full_name += (full_name.empty() ? "" : "::") + part;
+
+        class_compound compound;
+        scanned_attribute_class attribute;
+        if(is_attribute)
+        {
+            attribute.name = full_name;
+            inner.attribute = &attribute;
+        }
+        else
+        {
+            compound.refid = full_name;
+            compound.full_name = full_name;
+            compound.definition_header = file_name;
+            compound.template_params = template_params;
+            inner.compound = &compound;
+        }
+
+        pos = open + 1;
+        parse_scope(inner);
+        skip_to_semicolon(); // variables declared along with the class.
+
+        if(is_attribute) out.attribute_classes.push_back(std::move(attribute));
+        else out.classes.push_back(std::move(compound));
+    }
+
+    void parse_statement(scope_context &ctx)
+    {
+        if(is(pos, ";"))
+        {
+            pos++;
+            return;
+        }
+        if((ctx.compound || ctx.attribute) && is(pos+1, ":")
+           && (is(pos, "public") || is(pos, "protected") || is(pos, "private")))
+        {
+            ctx.is_public = is(pos, "public");
+            pos += 2;
+            return;
+        }
+
+        vector<string> template_params;
+        while(is(pos, "template") && is(pos+1, "<"))
+        {
+            const size_t close = skip_angles(pos+1);
+            template_params = parse_template_params(pos+2, close-1);
+            pos = close;
+        }
+
+        const size_t first = pos;
+        const size_t last = find_statement_end(first);
+        const bool has_body = is(last, "{");
+        if(last == tokens.size() || is(last, "}"))
+        {
+            pos = last;
+            return;
+        }
+
+        if(is(first, "namespace") || (is(first, "inline") && is(first+1, "namespace")))
+        {
+            if(!has_body) // namespace alias
+            {
+                pos = last + 1;
+                return;
+            }
+            scope_context inner;
+            inner.names = ctx.names;
+            for(size_t i = first; i < last; i++)
+                if(is_identifier(i) && !is(i, "namespace") && !is(i, "inline")) inner.names.push_back(text(i));
+            pos = last + 1;
+            parse_scope(inner);
+            return;
+        }
+        if(is(first, "extern") && last == first + 2 && tokens[first+1].kind == token::LITERAL) // extern "C" { }
+        {
+            scope_context inner;
+            inner.names = ctx.names;
+            pos = last + 1;
+            parse_scope(inner);
+            return;
+        }
+        if(is(first, "using") || is(first, "typedef") || is(first, "friend") || is(first, "enum")
+           || is(first, "static_assert"))
+        {
+            if(has_body)
+            {
+                pos = skip_balanced(last);
+                skip_to_semicolon();
+            }
+            else pos = last + 1;
+            return;
+        }
+        if(is(first, "class") || is(first, "struct") || is(first, "union"))
+        {
+            if(has_body) parse_class(ctx, first, last, template_params);
+            else pos = last + 1; // forward declaration
+            return;
+        }
+
+        handle_declaration(ctx, first, last);
+        // function bodies and brace initializers get skipped, the ';' after the latter is an empty statement.
+        pos = has_body ? skip_balanced(last) : last + 1;
+    }
+
+  public:
+    declaration_parser(const char *data, const vector<token> &tokens, const string &file_name, scanned_source_file &out)
+        : data(data), tokens(tokens), file_name(file_name), out(out) {}
+
+    bool at_end() const { return pos >= tokens.size(); }
+
+    /// Parses declarations until the closing '}' of this scope (or the end of the file).
+    void parse_scope(scope_context &ctx)
+    {
+        while(pos < tokens.size())
+        {
+            if(is(pos, "}"))
+            {
+                pos++;
+                return;
+            }
+            parse_statement(ctx);
+        }
+    }
+};
+
+/// Looks a type name up from the innermost scope outwards, like the compiler would do for classes.
+void resolve_type(const unordered_map<string, class_compound> &class_compounds, const vector<string> &scope,
+                  const vector<string> &template_params, SharedVariable::type_node_t &type)
+{
+    for(auto &template_type : type.template_types)
+        resolve_type(class_compounds, scope, template_params, template_type);
+
+    if(find(template_params.begin(), template_params.end(), type.refid) != template_params.end()) return;
+    if(type.refid.compare(0, 2, "::") == 0)
+    {
+        const string name = type.refid.substr(2);
+        if(class_compounds.count(name)) type.refid = name;
+        return;
+    }
+    for(size_t k = scope.size() + 1; k-- > 0;)
+    {
+        string candidate;
+        for(size_t j = 0; j < k; j++) candidate += scope[j] + "::";
+        candidate += type.refid;
+        if(class_compounds.count(candidate))
+        {
+            type.refid = candidate;
+            return;
+        }
+    }
+}
+
+} // namespace
+
+void scan_source(const char *data, size_t size, const string &file_name, scanned_source_file &out)
+{
+    const vector<token> tokens = tokenize(data, size);
+    declaration_parser parser(data, tokens, file_name, out);
+    scope_context global_scope;
+    // stray '}' (e.g. from macros we do not expand) end the global scope, we just continue behind them.
+    while(!parser.at_end()) parser.parse_scope(global_scope);
+}
+
+void resolve_scanned_types(const unordered_map<string, class_compound> &class_compounds, vector<SharedVariable> &shared_vars)
+{
+    for(SharedVariable &var : shared_vars)
+        resolve_type(class_compounds, var.var_namespace, vector<string>(), var.type);
+}
+
+void resolve_scanned_types(const unordered_map<string, class_compound> &class_compounds, class_compound &compound)
+{
+    const vector<string> scope(split_by_delimiter(compound.full_name, "::"));
+    for(SharedVariable &member : compound.marked_members)
+        resolve_type(class_compounds, scope, compound.template_params, member.type);
+}
+
+} } // namespace inexor::gluegen
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "inexor/gluegen/SharedVariables.hpp"
+#include "inexor/gluegen/SharedVarDatatypes.hpp"
+#include "inexor/gluegen/SharedAttributes.hpp"
+
+#include <string>
+#include <vector>
+
+namespace inexor { namespace gluegen {
+
+/// A class deriving from SharedOption, as found by scan_source.
+struct scanned_attribute_class
+{
+    /// The complete name including the namespace.
+    std::string name;
+
+    /// The public constructors with their raw arguments, see new_shared_attribute_definition.
+    std::vector<std::vector<function_parameter>> constructors;
+};
+
+/// Everything scan_source found in a single C++ file.
+///
+/// The types are not resolved yet: their refid is the type name as written (e.g. "SharedVar" or "inexor::Screen"),
+/// since the class might be declared in another file. See resolve_scanned_types.
+struct scanned_source_file
+{
+    /// The marked variables at namespace scope.
+    std::vector<SharedVariable> shared_vars;
+
+    /// All class definitions, their refid is the complete name (e.g. "inexor::rendering::Screen").
+    std::vector<class_compound> classes;
+
+    std::vector<scanned_attribute_class> attribute_classes;
+};
+
+/// Scans the C++ source of a header or source file for the declarations gluegen needs, without doxygen.
+///
+/// This is no C++ parser, but a lightweight declaration scanner: it understands namespaces, (template) classes with
+/// access specifiers and base classes, constructors with default arguments and variables with "=", "(" or "{"
+/// initializers. Function bodies, enums, preprocessor lines and comments get skipped, macros do not get expanded.
+/// @param file_name gets used as definition_header of the classes.
+extern void scan_source(const char *data, size_t size, const std::string &file_name, scanned_source_file &out);
+
+/// Resolves the refids of the types of the variables (and class members) to the refids of the classes,
+/// by looking the written names up from the innermost enclosing namespace (or class) outwards.
+extern void resolve_scanned_types(const std::unordered_map<std::string, class_compound> &class_compounds,
+                                  std::vector<SharedVariable> &shared_vars);
+
+/// Same for the marked members of a class, the template parameters of the class stay unresolved.
+extern void resolve_scanned_types(const std::unordered_map<std::string, class_compound> &class_compounds,
+                                  class_compound &compound);
+
+} } // namespace inexor::gluegen
@@ -0,0 +1,134 @@
+#include "inexor/gluegen/stage_timings.hpp"
+#include "inexor/gluegen/binary_records.hpp"
+#include "inexor/filesystem/path.hpp"
+
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h> // linked in inexor/gluegen/CMakeLists.txt
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+namespace inexor { namespace gluegen {
+
+stage_timings *stage_timings::tracing = nullptr;
+
+size_t peak_rss_bytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss); // bytes on macOS
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes on Linux
+#endif
+#endif
+}
+
+void stage_timings::add_stage(const string &category, const string &name, clock::time_point start, clock::time_point end)
+{
+    const bool is_stage = category == "stage";
+    std::lock_guard<std::mutex> lock(mutex);
+    const size_t thread = thread_numbers.emplace(std::this_thread::get_id(), thread_numbers.size()).first->second;
+    stage_list.push_back({category, name, start - run_start, end - start, thread});
+    // the memory usage after each stage.
+    if(is_stage && tracing == this)
+        counter_samples.push_back({"peak_rss_mb", end - run_start, peak_rss_bytes() / (1024.0 * 1024.0)});
+}
+
+void stage_timings::set_count(const string &name, size_t count)
+{
+    add_counter_sample(name, static_cast<double>(count));
+    std::lock_guard<std::mutex> lock(mutex);
+    for(auto &entry : counts)
+        if(entry.first == name)
+        {
+            entry.second = count;
+            return;
+        }
+    counts.emplace_back(name, count);
+}
+
+void stage_timings::add_counter_sample(const string &name, double value)
+{
+    const clock::duration time = clock::now() - run_start;
+    std::lock_guard<std::mutex> lock(mutex);
+    counter_samples.push_back({name, time, value});
+}
+
+/// Names are ours or file names, so quotes, backslashes and control chars are all we need to escape.
+static string json_string(const string &str)
+{
+    string out = "\"";
+    for(const char c : str)
+    {
+        if(c == '"' || c == '\\') out += '\\';
+        if(static_cast<unsigned char>(c) < 0x20) out += ' ';
+        else out += c;
+    }
+    return out + "\"";
+}
+
+bool stage_timings::write_json(const string &file, size_t jobs) const
+{
+    using std::chrono::duration;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3);
+    json << "{\n  \"gluegen_version\": " << json_string(gluegen_version) << ",\n  \"jobs\": " << jobs << ",\n  \"stages\": [";
+    bool first = true;
+    for(const stage &s : stage_list)
+    {
+        if(s.category != "stage") continue;
+        json << (first ? "\n" : ",\n") << "    {\"name\": " << json_string(s.name)
+             << ", \"ms\": " << duration<double, std::milli>(s.duration).count() << "}";
+        first = false;
+    }
+    json << "\n  ],\n  \"counts\": {";
+    for(size_t i = 0; i < counts.size(); i++)
+        json << (i ? ",\n" : "\n") << "    " << json_string(counts[i].first) << ": " << counts[i].second;
+    json << "\n  }\n}\n";
+
+    const string contents = json.str();
+    return filesystem::write_file_atomically(file, contents.data(), contents.size());
+}
+
+bool stage_timings::write_trace(const string &file) const
+{
+    using std::chrono::duration;
+    typedef duration<double, std::micro> microseconds;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3);
+    json << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    json << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"gluegen "
+         << gluegen_version << "\"}}";
+    // complete events, the trace viewer nests them by time on each thread.
+    for(const stage &s : stage_list)
+    {
+        json << ",\n  {\"name\": " << json_string(s.name) << ", \"cat\": " << json_string(s.category)
+             << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << s.thread
+             << ", \"ts\": " << microseconds(s.start).count() << ", \"dur\": " << microseconds(s.duration).count() << "}";
+    }
+    for(const counter_sample &c : counter_samples)
+    {
+        json << ",\n  {\"name\": " << json_string(c.name) << ", \"ph\": \"C\", \"pid\": 1"
+             << ", \"ts\": " << microseconds(c.time).count() << ", \"args\": {\"value\": " << c.value << "}}";
+    }
+    json << "\n]}\n";
+
+    const string contents = json.str();
+    return filesystem::write_file_atomically(file, contents.data(), contents.size());
+}
+
+} } // namespace inexor::gluegen
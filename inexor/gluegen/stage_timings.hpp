@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <utility>
+
+namespace inexor { namespace gluegen {
+
+/// Measures how long the stages of one gluegen run take, together with the sizes of what got processed.
+/// The report can be written as json, so runs of different gluegen versions on the same input can be compared.
+///
+/// When tracing gets enabled it also records details (each parsed file, each resolved class, each rendered file)
+/// and counter samples, which can be written as Chrome trace-event json (view it in chrome://tracing or Perfetto).
+/// Recording is thread safe.
+class stage_timings
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    /// The timings detail_scopes get recorded to, nullptr (the default) disables recording details.
+    static stage_timings *tracing;
+
+    /// Measures a stage from its construction until its destruction (or until stop() gets called).
+    class scope
+    {
+        stage_timings *timings;
+        std::string category, name;
+        clock::time_point start;
+
+    public:
+        scope(stage_timings &timings, std::string name) : scope(&timings, "stage", std::move(name)) {}
+        scope(stage_timings *timings, const char *category, std::string name)
+            : timings(timings), category(category), name(std::move(name)), start(clock::now()) {}
+        ~scope() { stop(); }
+        scope(const scope &) = delete;
+        scope &operator=(const scope &) = delete;
+
+        void stop()
+        {
+            if(!timings) return;
+            timings->add_stage(category, name, start, clock::now());
+            timings = nullptr;
+        }
+    };
+
+    /// A scope which only gets recorded while tracing.
+    class detail_scope : public scope
+    {
+    public:
+        detail_scope(const char *category, const std::string &name)
+            : scope(tracing, category, tracing ? name : std::string()) {}
+    };
+
+    struct stage
+    {
+        std::string category, name;
+        /// Relative to the construction of the stage_timings.
+        clock::duration start, duration;
+        /// Small numbers instead of the thread ids, the first recording thread gets 0.
+        size_t thread;
+    };
+
+    struct counter_sample
+    {
+        std::string name;
+        clock::duration time;
+        double value;
+    };
+
+    stage_timings() : run_start(clock::now()) {}
+
+    void add_stage(const std::string &category, const std::string &name, clock::time_point start, clock::time_point end);
+
+    /// Remember the size of some input or output, e.g. the number of shared variables.
+    /// It gets sampled as counter for the trace as well.
+    void set_count(const std::string &name, size_t count);
+
+    /// Record the current value of a counter for the trace.
+    void add_counter_sample(const std::string &name, double value);
+
+    /// Writes {"gluegen_version": .., "jobs": .., "stages": [{"name": .., "ms": ..}, ..], "counts": {..}}.
+    /// Only the stages are included, not the details.
+    /// @return false if the file could not be written.
+    bool write_json(const std::string &file, size_t jobs) const;
+
+    /// Writes everything recorded in the Chrome trace-event format.
+    /// @return false if the file could not be written.
+    bool write_trace(const std::string &file) const;
+
+private:
+    mutable std::mutex mutex;
+    clock::time_point run_start;
+    std::vector<stage> stage_list;
+    std::vector<counter_sample> counter_samples;
+    std::vector<std::pair<std::string, size_t>> counts;
+    std::unordered_map<std::thread::id, size_t> thread_numbers;
+};
+
+/// The peak resident set size (memory usage) of this process so far, 0 if unknown.
+extern size_t peak_rss_bytes();
+
+} } // namespace inexor::gluegen
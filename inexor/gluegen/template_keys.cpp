@@ -0,0 +1,69 @@
+
+#include "inexor/gluegen/template_keys.hpp"
+#include "inexor/gluegen/parse_helpers.hpp"
+
+#include <boost/algorithm/string.hpp>
+
+using std::string;
+using std::vector;
+using boost::algorithm::trim;
+
+namespace inexor { namespace gluegen {
+
+used_template_keys::used_template_keys(const vector<string> &templates) : everything(false)
+{
+    for(const string &tmpl : templates)
+        add_template(tmpl);
+}
+
+void used_template_keys::add_template(const string &mustache_template)
+{
+    if(everything) return;
+
+    size_t pos = 0;
+    while((pos = mustache_template.find("{{", pos)) != string::npos)
+    {
+        // {{name}}, {{#name}}, {{^name}}, {{/name}}, {{&name}}, {{{name}}}, {{>partial}}, {{!comment}} or {{=<% %>=}}
+        size_t start = pos + 2;
+        const bool triple_mustache = start < mustache_template.size() && mustache_template[start] == '{';
+        if(triple_mustache) start++;
+        const size_t end = mustache_template.find(triple_mustache ? "}}}" : "}}", start);
+        if(end == string::npos) return; // unterminated tag, rendering reports the error.
+        pos = end + (triple_mustache ? 3 : 2);
+
+        string tag = mustache_template.substr(start, end - start);
+        trim(tag);
+        if(tag.empty()) continue;
+
+        const char sigil = tag[0];
+        if(sigil == '!' || sigil == '>') continue; // comments and partials (which are not part of the data).
+        if(sigil == '=')
+        {
+            everything = true; // we do not follow custom delimiters.
+            return;
+        }
+        if(sigil == '#' || sigil == '^' || sigil == '/' || sigil == '&')
+        {
+            tag.erase(0, 1);
+            trim(tag);
+        }
+        // dotted names look up every part.
+        for(const string &part : split_by_delimiter(tag, "."))
+            if(!part.empty()) keys.insert(part);
+    }
+}
+
+bool used_template_keys::is_used(const string &key) const
+{
+    return everything || keys.count(key) != 0;
+}
+
+bool used_template_keys::is_any_used_with_prefix(const string &prefix) const
+{
+    if(everything) return true;
+    for(const string &key : keys)
+        if(key.compare(0, prefix.size(), prefix) == 0) return true;
+    return false;
+}
+
+} } // namespace inexor::gluegen
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace inexor { namespace gluegen {
+
+/// The names of all keys the mustache templates refer to.
+///
+/// We use this to only build those parts of the template data which any template actually uses.
+/// The analysis is conservative: if we can not follow a template (e.g. it sets custom delimiters), every key counts as used.
+class used_template_keys
+{
+    std::unordered_set<std::string> keys;
+    bool everything = true;
+
+public:
+    /// Every key counts as used.
+    used_template_keys() {}
+
+    /// Only the keys used in one of these templates count as used.
+    explicit used_template_keys(const std::vector<std::string> &templates);
+
+    /// Adds the keys used in a further template.
+    void add_template(const std::string &mustache_template);
+
+    bool is_used(const std::string &key) const;
+
+    /// Whether any key beginning with prefix is used (e.g. "is_" for all the "is_<type>" flags).
+    bool is_any_used_with_prefix(const std::string &prefix) const;
+};
+
+} } // namespace inexor::gluegen